@@ -0,0 +1,272 @@
+// 请求头解析微基准:按行解析的状态机 vs http_scanner(逐字节/SSE4.2/AVX2)，字段名由header_table分类
+// 编译: cmake -DBUILD_BENCH=ON .. && make parser_bench
+// 状态机部分照搬http_conn的parse_line、parse_request_line和parse_headers，只保留解析，不处理请求
+// 两边每次都先把请求拷贝到工作缓冲区(解析会把分隔符改成\0)，拷贝的开销一样
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+#include "../http/http_scanner.h"
+#include "../http/header_table.hpp"
+
+static const int ROUNDS = 1000000;
+
+// curl发出的最简单的GET
+static const char *g_small =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+// 浏览器发出的GET，请求头多且长
+static const char *g_browser =
+    "GET /picture.html HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Referer: http://127.0.0.1:9006/judge.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=zh-CN\r\n"
+    "\r\n";
+
+// 登录的POST，只解析请求头
+static const char *g_post =
+    "POST /3CGISQL.cgi HTTP/1.1\r\n"
+    "Host: 127.0.0.1:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 21\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Origin: http://127.0.0.1:9006\r\n"
+    "Referer: http://127.0.0.1:9006/log.html\r\n"
+    "\r\n";
+
+// 解析结果，防止编译器把解析优化掉
+struct result
+{
+    bool keep_alive;
+    long content_length;
+    const char *url;
+    const char *host;
+};
+
+static long g_sink = 0;
+
+static void consume(const result &r)
+{
+    g_sink += r.keep_alive + r.content_length + (r.url ? r.url[1] : 0) + (r.host ? r.host[0] : 0);
+}
+
+/*** 按行解析的状态机 ***/
+
+enum LINE_STATUS
+{
+    LINE_OK = 0,
+    LINE_BAD,
+    LINE_OPEN
+};
+
+static LINE_STATUS parse_line(char *buf, int &checked, int read)
+{
+    for (; checked < read; ++checked)
+    {
+        char temp = buf[checked];
+        if (temp == '\r')
+        {
+            if (checked + 1 == read)
+                return LINE_OPEN;
+            else if (buf[checked + 1] == '\n')
+            {
+                buf[checked++] = '\0';
+                buf[checked++] = '\0';
+                return LINE_OK;
+            }
+            return LINE_BAD;
+        }
+        else if (temp == '\n')
+        {
+            if (checked > 1 && buf[checked - 1] == '\r')
+            {
+                buf[checked - 1] = '\0';
+                buf[checked++] = '\0';
+                return LINE_OK;
+            }
+            return LINE_BAD;
+        }
+    }
+    return LINE_OPEN;
+}
+
+static bool parse_request_line(char *text, result &r)
+{
+    char *url = strpbrk(text, " \t");
+    if (!url)
+        return false;
+    *url++ = '\0';
+    if (strcasecmp(text, "GET") != 0 && strcasecmp(text, "POST") != 0)
+        return false;
+    url += strspn(url, " \t");
+    char *version = strpbrk(url, " \t");
+    if (!version)
+        return false;
+    *version++ = '\0';
+    version += strspn(version, " \t");
+    if (strcasecmp(version, "HTTP/1.1") != 0)
+        return false;
+    r.url = url;
+    return url[0] == '/';
+}
+
+// 返回true表示读到了空行
+static bool parse_headers(char *text, result &r)
+{
+    if (text[0] == '\0')
+        return true;
+    else if (strncasecmp(text, "Connection:", 11) == 0)
+    {
+        text += 11;
+        text += strspn(text, " \t");
+        if (strcasecmp(text, "keep-alive") == 0)
+            r.keep_alive = true;
+    }
+    else if (strncasecmp(text, "Content-length:", 15) == 0)
+    {
+        text += 15;
+        text += strspn(text, " \t");
+        r.content_length = atol(text);
+    }
+    else if (strncasecmp(text, "Host:", 5) == 0)
+    {
+        text += 5;
+        text += strspn(text, " \t");
+        r.host = text;
+    }
+    return false;
+}
+
+static bool parse_state_machine(char *buf, int len)
+{
+    result r = {false, 0, nullptr, nullptr};
+    int checked = 0;
+    int start = 0;
+    bool request_line = true;
+    while (parse_line(buf, checked, len) == LINE_OK)
+    {
+        char *text = buf + start;
+        start = checked;
+        if (request_line)
+        {
+            if (!parse_request_line(text, r))
+                return false;
+            request_line = false;
+        }
+        else if (parse_headers(text, r))
+        {
+            consume(r);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*** http_scanner + 完美哈希分类字段名 ***/
+
+static bool parse_scanner(char *buf, int len)
+{
+    http_request_head head;
+    if (http_scanner::parse_request(buf, len, head) <= 0)
+        return false;
+    result r = {false, 0, nullptr, nullptr};
+    // 和http_conn::scan_request一样把字段原地改成\0结尾
+    auto terminate = [buf](std::string_view field) {
+        char *p = buf + (field.data() - buf);
+        p[field.size()] = '\0';
+        return p;
+    };
+    char *method = terminate(head.method);
+    r.url = terminate(head.target);
+    char *version = terminate(head.version);
+    if (strcasecmp(method, "GET") != 0 && strcasecmp(method, "POST") != 0)
+        return false;
+    if (strcasecmp(version, "HTTP/1.1") != 0 || r.url[0] != '/')
+        return false;
+    for (int i = 0; i < head.header_cnt; ++i)
+    {
+        const http_header &h = head.headers[i];
+        switch (lookup_header(h.name))
+        {
+        case HEADER_CONNECTION:
+            r.keep_alive = strcasecmp(terminate(h.value), "keep-alive") == 0;
+            break;
+        case HEADER_CONTENT_LENGTH:
+            r.content_length = atol(terminate(h.value));
+            break;
+        case HEADER_HOST:
+            r.host = terminate(h.value);
+            break;
+        default:
+            break;
+        }
+    }
+    consume(r);
+    return true;
+}
+
+typedef bool (*parse_fn)(char *buf, int len);
+
+// 返回每个请求的纳秒数
+static double run(parse_fn parse, const char *request)
+{
+    int len = strlen(request);
+    char buf[4096];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; ++i)
+    {
+        memcpy(buf, request, len);
+        if (!parse(buf, len))
+        {
+            fprintf(stderr, "parse failed\n");
+            exit(1);
+        }
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return (double)ns / ROUNDS;
+}
+
+static void bench(const char *name, const char *request)
+{
+    int len = strlen(request);
+    double ns = run(parse_state_machine, request);
+    printf("%-8s %6d %-14s %10.1f %10.1f\n", name, len, "state-machine", ns, len / ns * 1000);
+    for (int isa = http_scanner::SCALAR; isa <= http_scanner::AVX2; ++isa)
+    {
+        if (!http_scanner::set_isa((http_scanner::ISA)isa))
+            continue;
+        ns = run(parse_scanner, request);
+        printf("%-8s %6d %-14s %10.1f %10.1f\n", name, len, http_scanner::isa_name((http_scanner::ISA)isa), ns, len / ns * 1000);
+    }
+}
+
+int main()
+{
+    printf("%-8s %6s %-14s %10s %10s\n", "request", "bytes", "parser", "ns/req", "MB/s");
+    bench("small", g_small);
+    bench("browser", g_browser);
+    bench("post", g_post);
+    printf("(sink %ld)\n", g_sink);
+    return 0;
+}
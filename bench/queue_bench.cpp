@@ -0,0 +1,160 @@
+// 队列微基准:互斥锁保护的环形队列 vs 无锁mpmc_ring(逐个和批量)
+// 编译: cmake -DBUILD_BENCH=ON .. && make queue_bench
+// 每个线程交替push和pop，线程数从1到64，总操作数固定，统计每次操作的平均耗时(所有线程的总时间除以总操作数)
+// 锁的版本和原来的block_queue、线程池一样:一把锁保护数组，push和pop都要拿锁
+#include <pthread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../lock/locker.hpp"
+#include "../lock/mpmc_ring.hpp"
+
+static const long TOTAL_OPS = 4 * 1024 * 1024; // 每种队列、每种线程数的push+pop总次数
+static const int CAPACITY = 1024;
+static const int BATCH = 16;
+static const int THREADS[] = {1, 2, 4, 8, 16, 32, 64};
+
+// 互斥锁加数组的有界队列
+class locked_queue
+{
+public:
+    explicit locked_queue(int capacity) : m_items(capacity), m_head(0), m_size(0) {}
+
+    bool push(long item)
+    {
+        m_lock.lock();
+        if (m_size == (int)m_items.size())
+        {
+            m_lock.unlock();
+            return false;
+        }
+        m_items[(m_head + m_size) % m_items.size()] = item;
+        ++m_size;
+        m_lock.unlock();
+        return true;
+    }
+
+    bool pop(long &item)
+    {
+        m_lock.lock();
+        if (0 == m_size)
+        {
+            m_lock.unlock();
+            return false;
+        }
+        item = m_items[m_head];
+        m_head = (m_head + 1) % m_items.size();
+        --m_size;
+        m_lock.unlock();
+        return true;
+    }
+
+private:
+    locker m_lock;
+    std::vector<long> m_items;
+    int m_head;
+    int m_size;
+};
+
+// 所有线程就绪后同时开始，返回每次操作的纳秒数
+template <typename F>
+static double run_threads(int threads, F body)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    long per_thread = TOTAL_OPS / threads;
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&, i]() {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            body(i, per_thread);
+        });
+    }
+    while (ready.load() < threads)
+        std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto &t : workers)
+        t.join();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return (double)ns / (per_thread * threads);
+}
+
+static double bench_locked(int threads)
+{
+    locked_queue queue(CAPACITY);
+    return run_threads(threads, [&](int id, long ops) {
+        long item;
+        for (long i = 0; i < ops; i += 2)
+        {
+            while (!queue.push(id))
+                std::this_thread::yield();
+            while (!queue.pop(item))
+                std::this_thread::yield();
+        }
+    });
+}
+
+static double bench_ring(int threads)
+{
+    mpmc_ring<long> ring(CAPACITY);
+    return run_threads(threads, [&](int id, long ops) {
+        long item;
+        for (long i = 0; i < ops; i += 2)
+        {
+            while (!ring.push(id))
+                std::this_thread::yield();
+            while (!ring.pop(item))
+                std::this_thread::yield();
+        }
+    });
+}
+
+// 每次push_batch和pop_batch各BATCH个，按元素个数计算操作数
+static double bench_ring_batch(int threads)
+{
+    mpmc_ring<long> ring(CAPACITY);
+    return run_threads(threads, [&](int id, long ops) {
+        long items[BATCH];
+        for (long i = 0; i < ops; i += 2 * BATCH)
+        {
+            for (int j = 0; j < BATCH; ++j)
+                items[j] = id;
+            for (int done = 0; done < BATCH;)
+            {
+                int n = ring.push_batch(items + done, BATCH - done);
+                if (0 == n)
+                    std::this_thread::yield();
+                done += n;
+            }
+            for (int done = 0; done < BATCH;)
+            {
+                int n = ring.pop_batch(items, BATCH - done);
+                if (0 == n)
+                    std::this_thread::yield();
+                done += n;
+            }
+        }
+    });
+}
+
+int main()
+{
+    printf("hardware threads: %u, %ld ops per run, capacity %d\n", std::thread::hardware_concurrency(), TOTAL_OPS, CAPACITY);
+    printf("%8s %14s %14s %14s   (ns/op)\n", "threads", "mutex", "mpmc_ring", "ring_batch16");
+    for (int threads : THREADS)
+    {
+        double locked = bench_locked(threads);
+        double ring = bench_ring(threads);
+        double batch = bench_ring_batch(threads);
+        printf("%8d %14.1f %14.1f %14.1f\n", threads, locked, ring, batch);
+    }
+    return 0;
+}
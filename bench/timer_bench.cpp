@@ -0,0 +1,166 @@
+// 定时器微基准:分层时间轮 vs 升序链表
+// 编译: cmake -DBUILD_BENCH=ON .. && make timer_bench
+// 每种规模分别测添加、调整(续期)、删除、批量到期四种操作的平均耗时
+// 链表的添加和调整是O(n)，规模大时只抽样SAMPLE次，预先按降序从头部插入填满链表
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "timer_list.hpp"
+
+static const int TIMEOUT_MS = 15000; // 和服务器一样15s超时
+static const int TICK_MS = 1000;
+static const int SAMPLE = 1000;
+
+static long g_fired = 0;
+
+static void bench_cb(client_data *)
+{
+    ++g_fired;
+}
+
+static timer_node *make_node(int64_t expire)
+{
+    auto *timer = new timer_node;
+    timer->expire = expire;
+    timer->cb_func = bench_cb;
+    timer->user_data = nullptr;
+    return timer;
+}
+
+class stopwatch
+{
+public:
+    stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+    // 返回每次操作的纳秒数
+    double per_op(long ops) const
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+        return ops > 0 ? (double)ns / ops : 0;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+static void report(const char *name, int n, double add, double adjust, double del, double expire)
+{
+    printf("%-6s %8d %12.1f %12.1f %12.1f %12.1f\n", name, n, add, adjust, del, expire);
+}
+
+static void bench_wheel(int n, std::mt19937 &rng)
+{
+    time_wheel wheel;
+    wheel.init(TICK_MS);
+    int64_t now = get_cur_ms();
+    // 和服务器一样，节点预先分配好(服务器中嵌在client_data里)，时间轮只负责挂上和摘下
+    std::vector<timer_node> pool(n);
+    std::vector<timer_node *> timers(n);
+    std::uniform_int_distribution<int> jitter(0, TIMEOUT_MS);
+
+    stopwatch add_sw;
+    for (int i = 0; i < n; ++i)
+    {
+        timers[i] = &pool[i];
+        timers[i]->expire = now + TIMEOUT_MS + jitter(rng);
+        timers[i]->cb_func = bench_cb;
+        timers[i]->user_data = nullptr;
+        wheel.add_timer(timers[i]);
+    }
+    double add = add_sw.per_op(n);
+
+    // 模拟连接上有数据到达，把超时时间往后推
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    stopwatch adjust_sw;
+    for (int i = 0; i < n; ++i)
+    {
+        timer_node *timer = timers[pick(rng)];
+        timer->expire += TIMEOUT_MS;
+        wheel.adjust_timer(timer);
+    }
+    double adjust = adjust_sw.per_op(n);
+
+    stopwatch del_sw;
+    for (int i = 0; i < n; i += 2)
+    {
+        wheel.del_timer(timers[i]);
+    }
+    double del = del_sw.per_op((n + 1) / 2);
+
+    int left = wheel.size();
+    g_fired = 0;
+    stopwatch expire_sw;
+    wheel.tick(now + 1000L * TIMEOUT_MS);
+    double expire = expire_sw.per_op(left);
+    if (g_fired != left)
+        printf("wheel: expired %ld of %d\n", g_fired, left);
+
+    report("wheel", n, add, adjust, del, expire);
+}
+
+static void bench_list(int n, std::mt19937 &rng)
+{
+    timer_list lst;
+    // 超时时间都放在过去，tick()时全部到期
+    int64_t base = get_cur_ms() - 1000L * TIMEOUT_MS;
+    std::vector<timer_node *> timers(n);
+
+    // 降序插入，每次都插在头部，填满链表是O(n)
+    for (int i = n - 1; i >= 0; --i)
+    {
+        timers[i] = make_node(base + i);
+        lst.add_timer(timers[i]);
+    }
+
+    // 新连接的超时时间比已有的都晚，要走到链表尾部
+    int sample = n < SAMPLE ? n : SAMPLE;
+    std::vector<timer_node *> extra(sample);
+    stopwatch add_sw;
+    for (int i = 0; i < sample; ++i)
+    {
+        extra[i] = make_node(base + n + i);
+        lst.add_timer(extra[i]);
+    }
+    double add = add_sw.per_op(sample);
+
+    std::uniform_int_distribution<int> pick(0, n - 1);
+    int64_t next = base + n + sample;
+    stopwatch adjust_sw;
+    for (int i = 0; i < sample; ++i)
+    {
+        timer_node *timer = timers[pick(rng)];
+        timer->expire = next++;
+        lst.adjust_timer(timer);
+    }
+    double adjust = adjust_sw.per_op(sample);
+
+    stopwatch del_sw;
+    for (int i = 0; i < n; i += 2)
+    {
+        lst.del_timer(timers[i]);
+    }
+    double del = del_sw.per_op((n + 1) / 2);
+
+    int left = lst.size();
+    g_fired = 0;
+    stopwatch expire_sw;
+    lst.tick();
+    double expire = expire_sw.per_op(left);
+    if (g_fired != left)
+        printf("list: expired %ld of %d\n", g_fired, left);
+
+    report("list", n, add, adjust, del, expire);
+}
+
+int main()
+{
+    std::mt19937 rng(419);
+    printf("%-6s %8s %12s %12s %12s %12s\n", "type", "timers", "add(ns)", "adjust(ns)", "del(ns)", "expire(ns)");
+    for (int n : {10000, 100000, 1000000})
+    {
+        bench_wheel(n, rng);
+        bench_list(n, rng);
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+#ifndef TIMER_LIST_HPP
+#define TIMER_LIST_HPP
+
+#include "../timer/timer.h"
+
+// 定时器链表类，服务器已改用time_wheel，只在timer_bench中作为对比
+// 为每个连接创建一个定时器，将其添加到链表中，并按照超时时间升序排列。执行定时任务时，将到期的定时器从链表中删除
+// 添加定时器的事件复杂度是O(n),删除定时器的事件复杂度是O(1)
+class timer_list
+{
+public:
+    timer_list() : head(nullptr), tail(nullptr), m_size(0) {}
+    ~timer_list();
+
+    // 添加定时器，内部调用私有成员add_timer
+    void add_timer(timer_node *timer);
+
+    // 调整定时器，任务发生变化时，调整定时器在链表中的位置
+    void adjust_timer(timer_node *timer);
+
+    // 删除定时器
+    void del_timer(timer_node *timer);
+
+    // 清理链表上到期的节点，服务器中由timerfd每次到期时调用
+    void tick();
+
+    // 链表中定时器的个数，即该链表管理的连接数
+    int size() const { return m_size; }
+
+private:
+    // 被add_timer调用，把一个节点按照超市顺序插入
+    void add_timer(timer_node *timer, timer_node *lst_head);
+
+    //头尾结点
+    timer_node *head;
+    timer_node *tail;
+    int m_size;
+};
+
+inline timer_list::~timer_list()
+{
+    timer_node *tmp = head;
+    while (tmp)
+    {
+        head = tmp->next;
+        delete tmp;
+        tmp = head;
+    }
+}
+
+// 添加定时器
+inline void timer_list::add_timer(timer_node *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    ++m_size;
+    // 如果当前链表为空
+    if (!head)
+    {
+        head = tail = timer;
+        return;
+    }
+    // 如果新的定时器超时时间小于当前头部结点，直接将新的定时器结点作为头部结点
+    if (timer->expire < head->expire)
+    {
+        timer->next = head;
+        head->prev = timer;
+        head = timer;
+        return;
+    }
+    // 否则调用私有成员函数add_timer查找合适的位置保证链表按照超时时间(expire)升序
+    add_timer(timer, head);
+}
+
+// 调整定时器，任务发生变化时，调整定时器在链表中的位置
+inline void timer_list::adjust_timer(timer_node *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+
+    // 被调整的定时器在链表尾部 or 定时器超时值仍然小于下一个定时器超时值，不调整
+    if (!timer->next || (timer->expire < timer->next->expire))
+    {
+        return;
+    }
+
+    // 被调整定时器是链表头结点，将定时器取出，调用私有成员函数add_timer重新插入
+    if (timer == head)
+    {
+        head = head->next;
+        head->prev = nullptr;
+        timer->next = nullptr;
+        add_timer(timer, head);
+    }
+    // 被调整定时器在内部，将定时器取出，调用私有成员函数add_timer重新插入
+    else
+    {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        add_timer(timer, timer->next);
+    }
+}
+
+// 删除定时器:即是双向链表节点的删除
+inline void timer_list::del_timer(timer_node *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    --m_size;
+    //链表中只有一个定时器，需要删除该定时器
+    if ((timer == head) && (timer == tail))
+    {
+        delete timer;
+        head = nullptr;
+        tail = nullptr;
+        return;
+    }
+
+    //被删除的定时器为头结点
+    if (timer == head)
+    {
+        head = head->next;
+        head->prev = nullptr;
+        delete timer;
+        return;
+    }
+
+    //被删除的定时器为尾结点
+    if (timer == tail)
+    {
+        tail = tail->prev;
+        tail->next = nullptr;
+        delete timer;
+        return;
+    }
+
+    //被删除的定时器在链表内部，常规链表结点删除
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    delete timer;
+}
+
+// 清理到期的链表节点，调用了cb_func()
+inline void timer_list::tick()
+{
+    if (!head)
+    {
+        return;
+    }
+
+    // 获取当前时间
+    int64_t cur = get_cur_ms();
+
+    // 遍历定时器链表
+    timer_node *tmp = head;
+    while (tmp)
+    {
+        // 链表容器为升序排列
+        // 当前时间小于头部定时器的超时时间，后面的定时器也没有到期，直接跳出
+        if (cur < tmp->expire)
+        {
+            break;
+        }
+
+        // 当前定时器到期，则调用回调函数，执行定时事件
+        tmp->cb_func(tmp->user_data);
+
+        // 将处理后的定时器从链表容器中删除，并重置头结点
+        head = tmp->next;
+        if (head)
+        {
+            head->prev = nullptr;
+        }
+        else
+        {
+            tail = nullptr;
+        }
+        --m_size;
+        delete tmp;
+        tmp = head;
+    }
+}
+
+// 找到应该插入的地方
+// TODO:使用C++11的优先队列实现定时器
+inline void timer_list::add_timer(timer_node *timer, timer_node *lst_head)
+{
+    timer_node *prev = lst_head;
+    timer_node *tmp = prev->next;
+    // 遍历链表，找到合适的位置
+    while (tmp)
+    {
+        if (timer->expire < tmp->expire)
+        {
+            prev->next = timer;
+            timer->next = tmp;
+            tmp->prev = timer;
+            timer->prev = prev;
+            break;
+        }
+        prev = tmp;
+        tmp = tmp->next;
+    }
+
+    //遍历完发现，目标定时器需要放到尾结点处
+    if (!tmp)
+    {
+        prev->next = timer;
+        timer->prev = prev;
+        timer->next = nullptr;
+        tail = timer;
+    }
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include "buffer_pool.h"
+
+buffer_pool::~buffer_pool()
+{
+    for (char *chunk : m_free)
+        delete[] chunk;
+}
+
+char *buffer_pool::get()
+{
+    m_lock.lock();
+    if (!m_free.empty())
+    {
+        char *chunk = m_free.back();
+        m_free.pop_back();
+        m_lock.unlock();
+        return chunk;
+    }
+    m_lock.unlock();
+    return new char[CHUNK_SIZE];
+}
+
+void buffer_pool::put(char *chunk)
+{
+    m_lock.lock();
+    if (m_free.size() < MAX_IDLE)
+    {
+        m_free.push_back(chunk);
+        chunk = nullptr;
+    }
+    m_lock.unlock();
+    delete[] chunk;
+}
+
+char *buffer_pool::space(std::vector<char *> &chunks, int used, int &len)
+{
+    if (used == (int)chunks.size() * CHUNK_SIZE)
+        chunks.push_back(get());
+    int offset = used % CHUNK_SIZE;
+    len = CHUNK_SIZE - offset;
+    return chunks.back() + offset;
+}
+
+void buffer_pool::put_all(std::vector<char *> &chunks)
+{
+    for (char *chunk : chunks)
+        put(chunk);
+    chunks.clear();
+}
+
+size_t buffer_pool::idle()
+{
+    m_lock.lock();
+    size_t n = m_free.size();
+    m_lock.unlock();
+    return n;
+}
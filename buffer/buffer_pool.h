@@ -0,0 +1,49 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include "../lock/locker.hpp"
+
+// 固定大小的内存块池，单例模式，所有连接共享
+// 连接的读写缓冲区都由若干块串起来，数据变多时再取一块，处理完的块还回池里
+// 空闲的连接不占用缓冲区，也不需要按最大请求或响应为每个连接预留内存
+class buffer_pool
+{
+public:
+    static const int CHUNK_SIZE = 2048;    // 每块的大小，一般的请求一块就够
+    static const size_t MAX_IDLE = 4096;   // 池里最多保留的空闲块数，多出来的直接释放
+
+    // C++11以后,使用局部变量懒汉不用加锁
+    static buffer_pool *get_instance()
+    {
+        static buffer_pool instance;
+        return &instance;
+    }
+
+    // 取一块，池里没有空闲块时新分配
+    char *get();
+
+    // 还回一块
+    void put(char *chunk);
+
+    // 池里的空闲块数
+    size_t idle();
+
+    // 由块串成的缓冲区中，已经写入used字节，返回可以继续写入的位置和长度，最后一块满了就再取一块
+    char *space(std::vector<char *> &chunks, int used, int &len);
+
+    // 缓冲区的块全部还回池里
+    void put_all(std::vector<char *> &chunks);
+
+private:
+    buffer_pool() {}
+    ~buffer_pool();
+
+private:
+    std::vector<char *> m_free; // 空闲块
+    locker m_lock;
+};
+
+#endif
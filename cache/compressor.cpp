@@ -0,0 +1,267 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "compressor.h"
+#include "file_cache.h"
+#include "../log/log.h"
+
+// 修改时间精确到纳秒，同一秒内的修改也能发现
+static int64_t mtime_ns(const struct stat &file_stat)
+{
+    return (int64_t)file_stat.st_mtim.tv_sec * 1000000000 + file_stat.st_mtim.tv_nsec;
+}
+
+static bool gzip_data(const std::string &in, std::string &out)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits加16输出gzip格式
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return Z_STREAM_END == ret;
+}
+
+static bool brotli_data(const std::string &in, std::string &out)
+{
+#ifdef HAVE_BROTLI
+    size_t len = BrotliEncoderMaxCompressedSize(in.size());
+    if (0 == len)
+        return false;
+    out.resize(len);
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, in.size(),
+                               (const uint8_t *)in.data(), &len, (uint8_t *)&out[0]))
+        return false;
+    out.resize(len);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// 逐级创建path所在的目录
+static void make_parent_dirs(const std::string &path)
+{
+    for (size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+        mkdir(path.substr(0, pos).c_str(), 0755);
+}
+
+// 先写到临时文件再改名，请求线程不会读到写了一半的文件
+static bool write_file(const std::string &path, const std::string &data, const struct stat &file_stat)
+{
+    make_parent_dirs(path);
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    size_t have_write = 0;
+    while (have_write < data.size())
+    {
+        ssize_t ret = ::write(fd, data.data() + have_write, data.size() - have_write);
+        if (ret <= 0)
+        {
+            if (ret < 0 && EINTR == errno)
+                continue;
+            break;
+        }
+        have_write += ret;
+    }
+    // 压缩文件的修改时间和原文件相同，原文件修改后两者不一致，压缩文件自动失效
+    struct timespec times[2] = {file_stat.st_atim, file_stat.st_mtim};
+    bool ok = have_write == data.size() && 0 == futimens(fd, times);
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+compressor::compressor() : m_stop(false), m_thread(0), m_close_log(0)
+{
+}
+
+// 通知压缩线程退出并等待它结束，没压缩完的文件下次启动再压缩
+compressor::~compressor()
+{
+    if (m_thread)
+    {
+        m_mutex.lock();
+        m_stop = true;
+        m_cond.broadcast();
+        m_mutex.unlock();
+        pthread_join(m_thread, nullptr);
+    }
+}
+
+bool compressor::init(const char *root, const char *dir, int close_log)
+{
+    m_close_log = close_log;
+    m_root = root;
+    m_dir = dir ? dir : "";
+    if (m_dir.empty())
+        return true;
+
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0)
+    {
+        m_thread = 0;
+        m_dir.clear();
+        return false;
+    }
+    return true;
+}
+
+const char *compressor::encoding_name(int encoding)
+{
+    return ENCODING_BR == encoding ? "br" : "gzip";
+}
+
+const char *compressor::encoding_ext(int encoding)
+{
+    return ENCODING_BR == encoding ? ".br" : ".gz";
+}
+
+bool compressor::cached_path(const char *path, int encoding, char *out, size_t len)
+{
+    if (strncmp(path, m_root.c_str(), m_root.size()) != 0)
+        return false;
+    const char *rel = path + m_root.size();
+    // 不能写到压缩目录外面
+    if (rel[0] != '/' || strstr(rel, "/.."))
+        return false;
+    return snprintf(out, len, "%s%s%s", m_dir.c_str(), rel, encoding_ext(encoding)) < (int)len;
+}
+
+int compressor::find(const char *path, const struct stat &file_stat, int accept, char *variant, size_t len)
+{
+    static const int encodings[] = {ENCODING_BR, ENCODING_GZIP};
+    struct stat variant_stat;
+    for (int encoding : encodings)
+    {
+        if (!(accept & encoding))
+            continue;
+
+        // 同目录下的预压缩文件
+        if (snprintf(variant, len, "%s%s", path, encoding_ext(encoding)) < (int)len &&
+            0 == stat(variant, &variant_stat) && S_ISREG(variant_stat.st_mode) &&
+            mtime_ns(variant_stat) >= mtime_ns(file_stat))
+            return encoding;
+
+        // 后台压缩好的文件
+        if (!m_dir.empty() && cached_path(path, encoding, variant, len) && 0 == stat(variant, &variant_stat) &&
+            S_ISREG(variant_stat.st_mode) && mtime_ns(variant_stat) == mtime_ns(file_stat))
+            return encoding;
+    }
+
+    if (!m_dir.empty() && file_stat.st_size >= MIN_SIZE && file_stat.st_size <= MAX_SIZE)
+        submit(path, mtime_ns(file_stat));
+    return ENCODING_IDENTITY;
+}
+
+void compressor::submit(const char *path, int64_t mtime)
+{
+    m_mutex.lock();
+    auto it = m_seen.find(path);
+    if (it == m_seen.end() || it->second != mtime)
+    {
+        m_seen[path] = mtime;
+        m_queue.push_back(path);
+        m_cond.signal();
+    }
+    m_mutex.unlock();
+}
+
+void *compressor::worker(void *arg)
+{
+    auto *pool = (compressor *)arg;
+    pool->run();
+    return pool;
+}
+
+void compressor::run()
+{
+    while (true)
+    {
+        m_mutex.lock();
+        while (m_queue.empty() && !m_stop)
+            m_cond.wait(m_mutex.get());
+        if (m_stop)
+        {
+            m_mutex.unlock();
+            break;
+        }
+        std::string path = m_queue.front();
+        m_queue.pop_front();
+        m_mutex.unlock();
+
+        compress(path);
+    }
+}
+
+void compressor::compress(const std::string &path)
+{
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) < 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size > MAX_SIZE)
+        return;
+
+    std::string data(file_stat.st_size, '\0');
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    size_t have_read = 0;
+    while (have_read < data.size())
+    {
+        ssize_t ret = read(fd, &data[have_read], data.size() - have_read);
+        if (ret <= 0)
+        {
+            if (ret < 0 && EINTR == errno)
+                continue;
+            break;
+        }
+        have_read += ret;
+    }
+    close(fd);
+
+    // 读取过程中文件被修改，等下次请求重新提交
+    struct stat after;
+    if (have_read != data.size() || stat(path.c_str(), &after) < 0 || mtime_ns(after) != mtime_ns(file_stat))
+        return;
+
+    static const int encodings[] = {ENCODING_BR, ENCODING_GZIP};
+    char variant[512];
+    std::string out;
+    bool written = false;
+    for (int encoding : encodings)
+    {
+        bool ok = ENCODING_BR == encoding ? brotli_data(data, out) : gzip_data(data, out);
+        // 压缩后没有变小的不保存，原文件直接发送
+        if (!ok || out.size() >= data.size() || !cached_path(path.c_str(), encoding, variant, sizeof(variant)))
+            continue;
+        if (write_file(variant, out, file_stat))
+        {
+            // 文件缓存可能还有这个路径的旧内容
+            file_cache::get_instance()->remove(variant);
+            LOG_INFO("compressed %s: %zu -> %zu bytes", variant, data.size(), out.size());
+            written = true;
+        }
+    }
+    // 之前的请求记住的是原文件，重新选择
+    if (written)
+        file_cache::get_instance()->remove_variants(path);
+}
@@ -0,0 +1,74 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include "../lock/locker.hpp"
+
+// 响应的内容编码，按位表示浏览器Accept-Encoding接受的编码
+enum CONTENT_ENCODING
+{
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP = 1,
+    ENCODING_BR = 2
+};
+
+// 预压缩文件，单例模式
+// 请求可压缩的文件时先找同目录下的.br/.gz，再找后台压缩好的文件，只有修改时间不早于原文件才使用
+// 都没有时把文件交给后台线程压缩，本次请求仍然返回原文件，工作线程从不压缩
+// 后台压缩的文件放在压缩目录下，目录结构和资源目录相同，修改时间设为原文件的修改时间，原文件修改后自动失效
+class compressor
+{
+public:
+    static const off_t MIN_SIZE = 256;              // 太小的文件压缩后省不了多少
+    static const off_t MAX_SIZE = 8 * 1024 * 1024;  // 后台压缩的文件大小上限
+
+    // C++11以后,使用局部变量懒汉不用加锁
+    static compressor *get_instance()
+    {
+        static compressor instance;
+        return &instance;
+    }
+
+    // root为资源目录，dir为压缩目录，dir为空时不在后台压缩，只使用资源目录下已有的.br/.gz
+    bool init(const char *root, const char *dir, int close_log);
+
+    // 查找path的压缩版本，file_stat为原文件的信息，accept为浏览器接受的编码
+    // 找到时把压缩文件的路径写入variant并返回编码，否则返回ENCODING_IDENTITY
+    int find(const char *path, const struct stat &file_stat, int accept, char *variant, size_t len);
+
+    static const char *encoding_name(int encoding); // Content-Encoding字段值
+    static const char *encoding_ext(int encoding);  // 压缩文件的扩展名
+
+private:
+    compressor();
+    ~compressor();
+
+    static void *worker(void *arg); // 压缩线程执行函数(静态)
+    void run();
+
+    // 压缩目录下对应的路径，path不在资源目录下时返回false
+    bool cached_path(const char *path, int encoding, char *out, size_t len);
+    // 加入压缩队列，同一个文件的同一个版本只压缩一次
+    void submit(const char *path, int64_t mtime);
+    // 把path压缩成各种编码写到压缩目录，写完后替换旧文件
+    void compress(const std::string &path);
+
+private:
+    std::string m_root;
+    std::string m_dir;
+    std::deque<std::string> m_queue;                 // 待压缩的文件
+    std::unordered_map<std::string, int64_t> m_seen; // 已经提交过的文件和它当时的修改时间(纳秒)
+    locker m_mutex;
+    cond m_cond;
+    bool m_stop;
+    pthread_t m_thread;
+    int m_close_log;
+};
+
+#endif
@@ -0,0 +1,359 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "file_cache.h"
+#include "../log/log.h"
+
+file_cache::file_cache() : m_size(0), m_capacity(0), m_max_entry(0), m_generation(0), m_hits(0), m_misses(0),
+                           m_inotify_fd(-1), m_stop_fd(-1), m_thread(0), m_close_log(0)
+{
+}
+
+// 通知inotify线程退出并等待它结束
+file_cache::~file_cache()
+{
+    if (m_thread)
+    {
+        uint64_t one = 1;
+        ::write(m_stop_fd, &one, sizeof(one));
+        pthread_join(m_thread, nullptr);
+    }
+    if (m_inotify_fd != -1)
+        close(m_inotify_fd);
+    if (m_stop_fd != -1)
+        close(m_stop_fd);
+}
+
+// 单个文件最多占缓存的1/16，避免一个大文件把其他文件全部挤出去
+bool file_cache::init(const char *root, size_t capacity, int close_log)
+{
+    m_close_log = close_log;
+    m_capacity = capacity;
+    m_max_entry = capacity / 16;
+    if (0 == m_capacity)
+    {
+        return true;
+    }
+
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (m_inotify_fd < 0 || m_stop_fd < 0)
+    {
+        LOG_ERROR("%s", "file cache inotify init failed, cache disabled");
+        m_capacity = 0;
+        return false;
+    }
+    watch_dir(root);
+
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0)
+    {
+        m_thread = 0;
+        m_capacity = 0;
+        return false;
+    }
+    return true;
+}
+
+// inotify不能递归监听，给每一级子目录各加一个watch
+void file_cache::watch_dir(const std::string &dir)
+{
+    uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                    IN_DELETE_SELF | IN_MOVE_SELF;
+    int wd = inotify_add_watch(m_inotify_fd, dir.c_str(), mask);
+    if (wd < 0)
+    {
+        LOG_ERROR("inotify watch %s failed, errno is:%d", dir.c_str(), errno);
+        return;
+    }
+    m_watch_dirs[wd] = dir;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *ent = readdir(d))
+    {
+        if (DT_DIR == ent->d_type && strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0)
+        {
+            watch_dir(dir + "/" + ent->d_name);
+        }
+    }
+    closedir(d);
+}
+
+std::shared_ptr<const file_entry> file_cache::get(const char *path)
+{
+    if (!enabled())
+        return nullptr;
+
+    std::shared_ptr<const file_entry> entry;
+    m_cache_mutex.lock();
+    auto it = m_index.find(path);
+    if (it != m_index.end())
+    {
+        // 移到表头
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        entry = *it->second;
+    }
+    m_cache_mutex.unlock();
+
+    if (entry)
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+    else
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+    return entry;
+}
+
+void file_validator::init(const struct stat &file_stat)
+{
+    mtime = file_stat.st_mtime;
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)file_stat.st_mtime, (unsigned long)file_stat.st_size);
+    struct tm tm;
+    gmtime_r(&mtime, &tm);
+    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// 读文件在锁外进行，期间若有文件失效则不加入缓存，避免缓存旧内容
+std::shared_ptr<const file_entry> file_cache::load(const char *path, const struct stat &file_stat)
+{
+    if (!enabled() || !S_ISREG(file_stat.st_mode) || file_stat.st_size <= 0 || (size_t)file_stat.st_size > m_max_entry)
+        return nullptr;
+
+    m_cache_mutex.lock();
+    uint64_t generation = m_generation;
+    m_cache_mutex.unlock();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    auto entry = std::make_shared<file_entry>();
+    entry->path = path;
+    entry->body.resize(file_stat.st_size);
+    size_t have_read = 0;
+    while (have_read < entry->body.size())
+    {
+        ssize_t ret = read(fd, &entry->body[have_read], entry->body.size() - have_read);
+        if (ret <= 0)
+        {
+            if (ret < 0 && EINTR == errno)
+                continue;
+            break;
+        }
+        have_read += ret;
+    }
+    close(fd);
+    // 读取过程中文件被截断
+    if (have_read != entry->body.size())
+        return nullptr;
+
+    entry->validator.init(file_stat);
+    char headers[256];
+    snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Length:%zu\r\nETag:%s\r\nLast-Modified:%s\r\nAccept-Ranges:bytes\r\n",
+             entry->body.size(), entry->validator.etag, entry->validator.last_modified);
+    entry->headers = headers;
+
+    m_cache_mutex.lock();
+    if (generation == m_generation && m_index.find(entry->path) == m_index.end())
+    {
+        m_lru.push_front(entry);
+        m_index[entry->path] = m_lru.begin();
+        m_size += entry->body.size();
+        evict();
+    }
+    m_cache_mutex.unlock();
+    return entry;
+}
+
+void file_cache::evict()
+{
+    while (m_size > m_capacity && !m_lru.empty())
+    {
+        const auto &victim = m_lru.back();
+        m_size -= victim->body.size();
+        m_index.erase(victim->path);
+        m_lru.pop_back();
+    }
+}
+
+// 正在发送的连接持有shared_ptr，删除缓存不影响它们
+void file_cache::remove(const std::string &path)
+{
+    if (!enabled())
+        return;
+    m_cache_mutex.lock();
+    ++m_generation;
+    auto it = m_index.find(path);
+    if (it != m_index.end())
+    {
+        m_size -= (*it->second)->body.size();
+        m_lru.erase(it->second);
+        m_index.erase(it);
+    }
+    m_cache_mutex.unlock();
+}
+
+std::string file_cache::variant_key(const char *path, int accept)
+{
+    std::string key(path);
+    key += '\n';
+    key += (char)('0' + accept);
+    return key;
+}
+
+bool file_cache::find_variant(const char *path, int accept, file_variant &variant, uint64_t &generation)
+{
+    if (!enabled())
+        return false;
+    bool found = false;
+    m_cache_mutex.lock();
+    auto it = m_variants.find(variant_key(path, accept));
+    if (it != m_variants.end())
+    {
+        variant = it->second;
+        found = true;
+    }
+    generation = m_generation;
+    m_cache_mutex.unlock();
+    return found;
+}
+
+void file_cache::add_variant(const char *path, int accept, const file_variant &variant, uint64_t generation)
+{
+    if (!enabled())
+        return;
+    m_cache_mutex.lock();
+    if (generation == m_generation)
+    {
+        if (m_variants.size() >= MAX_VARIANTS)
+            m_variants.clear();
+        m_variants[variant_key(path, accept)] = variant;
+    }
+    m_cache_mutex.unlock();
+}
+
+void file_cache::remove_variants(const std::string &path)
+{
+    if (!enabled())
+        return;
+    m_cache_mutex.lock();
+    ++m_generation;
+    for (auto it = m_variants.begin(); it != m_variants.end();)
+    {
+        if (it->second.source == path)
+            it = m_variants.erase(it);
+        else
+            ++it;
+    }
+    m_cache_mutex.unlock();
+}
+
+void file_cache::invalidate(const std::string &name)
+{
+    m_cache_mutex.lock();
+    ++m_generation;
+    if (name.empty())
+    {
+        m_lru.clear();
+        m_index.clear();
+        m_size = 0;
+        m_variants.clear();
+    }
+    else
+    {
+        // 缓存的键是请求拼出来的路径，不一定和监听目录的写法完全一致，按文件名匹配
+        std::string suffix = "/" + name;
+        for (auto it = m_lru.begin(); it != m_lru.end();)
+        {
+            const std::string &path = (*it)->path;
+            if (path.size() >= suffix.size() && 0 == path.compare(path.size() - suffix.size(), suffix.size(), suffix))
+            {
+                m_size -= (*it)->body.size();
+                m_index.erase(path);
+                it = m_lru.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        // 原文件或者同目录下的压缩文件变了都要重新选择
+        auto match = [&suffix](const std::string &path) {
+            return path.size() >= suffix.size() && 0 == path.compare(path.size() - suffix.size(), suffix.size(), suffix);
+        };
+        for (auto it = m_variants.begin(); it != m_variants.end();)
+        {
+            if (match(it->second.source) || match(it->second.path))
+                it = m_variants.erase(it);
+            else
+                ++it;
+        }
+    }
+    m_cache_mutex.unlock();
+}
+
+void *file_cache::worker(void *arg)
+{
+    auto *cache = (file_cache *)arg;
+    cache->run();
+    return cache;
+}
+
+// 等待inotify事件，直到析构时m_stop_fd可读
+void file_cache::run()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2];
+    fds[0].fd = m_inotify_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_stop_fd;
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (EINTR == errno)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            continue;
+
+        for (char *ptr = buf; ptr < buf + len;)
+        {
+            auto *event = (struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            // 事件队列溢出、目录本身被删除或改名，无法确定影响了哪些文件，清空缓存
+            if ((event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) ||
+                ((event->mask & IN_ISDIR) && (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))))
+            {
+                invalidate("");
+            }
+            else if (event->len > 0)
+            {
+                invalidate(event->name);
+            }
+
+            // 新建或移入的子目录也要监听
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)) && event->len > 0)
+            {
+                auto it = m_watch_dirs.find(event->wd);
+                if (it != m_watch_dirs.end())
+                    watch_dir(it->second + "/" + event->name);
+            }
+            LOG_INFO("file cache invalidated by inotify event 0x%x", event->mask);
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <ctime>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../lock/locker.hpp"
+
+// 由stat信息生成的缓存校验字段，浏览器带回来时用于判断文件是否修改过
+struct file_validator
+{
+    char etag[48];          // "修改时间-大小"的十六进制，和nginx的格式相同
+    char last_modified[40]; // 修改时间，HTTP-date格式
+    time_t mtime;
+
+    void init(const struct stat &file_stat);
+};
+
+// 缓存的一个静态文件
+struct file_entry
+{
+    std::string path;         // 文件路径，即http_conn::m_real_file
+    std::string headers;      // 预先生成的状态行、Content-Length、ETag、Last-Modified和Accept-Ranges，其余字段和空行由请求决定
+    std::string body;         // 文件内容
+    file_validator validator; // 条件请求用
+};
+
+// 可压缩的文件在浏览器接受某些编码时选中的版本
+struct file_variant
+{
+    std::string source; // 原文件路径
+    std::string path;   // 压缩文件路径，不压缩时为空
+    int encoding;       // CONTENT_ENCODING
+};
+
+// 静态文件缓存，单例模式，所有工作线程共享
+// 按文件路径缓存文件内容和响应头，按总字节数限制大小，超出时淘汰最久未使用的(LRU)
+// 命中时不需要stat/open/mmap，直接writev
+// 用inotify监听资源目录，文件被修改、删除、改名或改权限时删除对应的缓存
+// 同时记住可压缩文件选中的压缩版本，命中时不需要stat原文件和各个压缩文件，失效规则和缓存的文件相同
+class file_cache
+{
+public:
+    // C++11以后,使用局部变量懒汉不用加锁
+    static file_cache *get_instance()
+    {
+        static file_cache instance;
+        return &instance;
+    }
+
+    // root为资源目录，capacity为缓存总字节数，为0时不缓存
+    bool init(const char *root, size_t capacity, int close_log);
+
+    // 是否启用缓存
+    bool enabled() const { return m_capacity > 0; }
+
+    // 查找缓存，未命中返回空
+    std::shared_ptr<const file_entry> get(const char *path);
+
+    // 未命中时读取文件并加入缓存，文件不可缓存(过大、不是普通文件等)时返回空
+    // file_stat为调用者已经stat得到的文件信息
+    std::shared_ptr<const file_entry> load(const char *path, const struct stat &file_stat);
+
+    // 删除一个文件的缓存，用于资源目录以外、inotify监听不到的文件
+    void remove(const std::string &path);
+
+    // 查找原文件path在浏览器接受accept编码时选中的版本，没有记录时返回false，generation交给add_variant
+    bool find_variant(const char *path, int accept, file_variant &variant, uint64_t &generation);
+
+    // 记住选中的版本，find_variant之后有文件失效时不记录
+    void add_variant(const char *path, int accept, const file_variant &variant, uint64_t generation);
+
+    // 忘掉原文件path选中的版本，后台压缩好新版本或者压缩文件不见了时调用
+    void remove_variants(const std::string &path);
+
+    // 统计
+    long hits() const { return m_hits.load(std::memory_order_relaxed); }
+    long misses() const { return m_misses.load(std::memory_order_relaxed); }
+    size_t size() const { return m_size; }
+
+private:
+    file_cache();
+    ~file_cache();
+
+    static void *worker(void *arg); // inotify线程执行函数(静态)
+    void run();
+
+    // 监听dir及其全部子目录
+    void watch_dir(const std::string &dir);
+
+    // 删除文件名为name的缓存，name为空时清空全部缓存
+    void invalidate(const std::string &name);
+
+    // 淘汰最久未使用的缓存直到总大小不超过容量，调用者持有锁
+    void evict();
+
+    // m_variants的键，原文件路径加上接受的编码
+    static std::string variant_key(const char *path, int accept);
+
+private:
+    typedef std::list<std::shared_ptr<const file_entry>> lru_list;
+
+    lru_list m_lru;                                               // 表头为最近使用的
+    std::unordered_map<std::string, lru_list::iterator> m_index; // 路径到链表节点
+    size_t m_size;                                                // 缓存的总字节数
+    size_t m_capacity;                                            // 缓存容量
+    size_t m_max_entry;                                           // 单个文件的大小上限
+    uint64_t m_generation;                                        // 每次失效加一，丢弃失效前开始读取的文件
+    std::unordered_map<std::string, file_variant> m_variants;     // 选中的压缩版本，记录太多时全部清空
+    static const size_t MAX_VARIANTS = 64 * 1024;
+    locker m_cache_mutex;
+
+    std::atomic<long> m_hits;
+    std::atomic<long> m_misses;
+
+    int m_inotify_fd;
+    int m_stop_fd; // eventfd，析构时通知inotify线程退出
+    pthread_t m_thread;
+    std::unordered_map<int, std::string> m_watch_dirs; // inotify watch描述符到目录
+    int m_close_log;
+};
+
+#endif
@@ -24,6 +24,12 @@ public:
         // 线程池内的线程数量,默认8
         m_thread_num = 8;
 
+        // 线程池最多的线程数量,默认32
+        m_max_thread_num = 32;
+
+        // 线程池数据库通道的线程数量,默认4
+        m_db_thread_num = 4;
+
         // 关闭日志,默认不关闭
         m_close_log = 0;
 
@@ -32,6 +38,36 @@ public:
 
         // 并发模型,默认是proactor
         m_actor_mode = 0;
+
+        // 从reactor数量,默认0即单reactor(主线程处理全部连接)
+        m_reactor_num = 0;
+
+        // 新连接分发策略,默认轮询
+        m_dispatch_mode = 0;
+
+        // SO_REUSEPORT监听分片数,默认0即只有主线程监听
+        m_listen_shards = 0;
+
+        // IO引擎,默认epoll
+        m_io_mode = 0;
+
+        // 定时器时间片,默认1000ms
+        m_tick_ms = 1000;
+
+        // 静态文件发送方式,默认mmap+writev
+        m_send_mode = 0;
+
+        // 静态文件缓存大小,默认64MB
+        m_cache_mb = 64;
+
+        // 静态文件的浏览器缓存时间,默认-1即不发送Cache-Control
+        m_max_age = -1;
+
+        // 后台压缩可压缩的静态文件,默认开启
+        m_compress = 1;
+
+        // 请求目录时返回文件列表,默认关闭
+        m_autoindex = 0;
     }
 
     ~Config(){};
@@ -40,7 +76,7 @@ public:
     void parse_arg(int argc, char *argv[])
     {
         int opt;
-        const char *str = "p:l:m:o:s:t:c:a:";
+        const char *str = "p:l:m:o:s:t:w:q:c:a:r:d:u:i:k:f:z:e:x:b:";
         while ((opt = getopt(argc, argv, str)) != -1)
         {
             switch (opt)
@@ -75,6 +111,16 @@ public:
                 m_thread_num = atoi(optarg);
                 break;
             }
+            case 'w':
+            {
+                m_max_thread_num = atoi(optarg);
+                break;
+            }
+            case 'q':
+            {
+                m_db_thread_num = atoi(optarg);
+                break;
+            }
             case 'c':
             {
                 m_close_log = atoi(optarg);
@@ -85,6 +131,56 @@ public:
                 m_actor_mode = atoi(optarg);
                 break;
             }
+            case 'r':
+            {
+                m_reactor_num = atoi(optarg);
+                break;
+            }
+            case 'd':
+            {
+                m_dispatch_mode = atoi(optarg);
+                break;
+            }
+            case 'u':
+            {
+                m_listen_shards = atoi(optarg);
+                break;
+            }
+            case 'i':
+            {
+                m_io_mode = atoi(optarg);
+                break;
+            }
+            case 'k':
+            {
+                m_tick_ms = atoi(optarg);
+                break;
+            }
+            case 'f':
+            {
+                m_send_mode = atoi(optarg);
+                break;
+            }
+            case 'z':
+            {
+                m_cache_mb = atoi(optarg);
+                break;
+            }
+            case 'e':
+            {
+                m_max_age = atoi(optarg);
+                break;
+            }
+            case 'x':
+            {
+                m_compress = atoi(optarg);
+                break;
+            }
+            case 'b':
+            {
+                m_autoindex = atoi(optarg);
+                break;
+            }
             default:
                 break;
             }
@@ -116,11 +212,47 @@ public:
     // 线程池内的线程数量
     int m_thread_num;
 
+    // 线程池最多的线程数量，任务排队太久时从m_thread_num增加到这么多，不大于m_thread_num时线程数固定
+    int m_max_thread_num;
+
+    // 线程池数据库通道的线程数量，注册这类要写数据库的请求由它们处理，为0时和其他请求一起处理
+    int m_db_thread_num;
+
     // 关闭日志
     int m_close_log;
 
     // 并发模型选择
     int m_actor_mode;
+
+    // 从reactor数量
+    int m_reactor_num;
+
+    // 新连接分发策略:0轮询,1最小负载
+    int m_dispatch_mode;
+
+    // SO_REUSEPORT监听分片数
+    int m_listen_shards;
+
+    // IO引擎:0为epoll,1为io_uring
+    int m_io_mode;
+
+    // 定时器时间片(毫秒)
+    int m_tick_ms;
+
+    // 静态文件发送方式:0为mmap+writev,1为大文件sendfile
+    int m_send_mode;
+
+    // 静态文件缓存大小(MB),0为不缓存
+    int m_cache_mb;
+
+    // 静态文件的浏览器缓存时间(秒):-1不发送Cache-Control,0为no-cache(每次都用ETag校验),大于0为max-age
+    int m_max_age;
+
+    // 后台压缩:0只使用资源目录下已有的.br/.gz,1在后台压缩到资源目录同级的<资源目录>_compressed
+    int m_compress;
+
+    // 目录的文件列表:0请求目录返回404,1边读目录边用chunked编码发送文件列表
+    int m_autoindex;
 };
 
 #endif
\ No newline at end of file
@@ -6,6 +6,7 @@ connection_pool::connection_pool()
 {
 	m_cur_conn = 0;
 	m_free_conn = 0;
+	m_max_conn = 0;
 }
 
 connection_pool *connection_pool::GetInstance()
@@ -53,11 +54,13 @@ void connection_pool::init_sql_pool(const string &url, const string &user, const
 }
 
 // 当有请求时，从数据库连接池中返回一个可用连接，更新使用和空闲连接数
+// 连接都被占用时阻塞到有连接归还，只有连接池里一个连接都没有时返回空
 MYSQL *connection_pool::get_conn()
 {
 	MYSQL *con = nullptr;
 
-	if (m_conn_list.empty())
+	// m_max_conn在初始化后不再改变，不加锁读取；m_conn_list会被其他线程修改，不能在锁外判断
+	if (0 == m_max_conn)
 		return nullptr;
 	// 取出连接，信号量原子减1，为0则等待
 	m_reserve_conn.wait();
@@ -0,0 +1,41 @@
+#ifndef CHUNK_SOURCE_H
+#define CHUNK_SOURCE_H
+
+#include <cstring>
+#include <string>
+#include <utility>
+
+// 分块发送(Transfer-Encoding:chunked)的响应正文，长度事先不知道
+// 发送时由http_conn每次取一段放进写缓冲区，上一段发送完毕后再取下一段，生成的内容不需要全部放在内存里
+class chunk_source
+{
+public:
+    virtual ~chunk_source() {}
+
+    // 向buf写入不超过len字节的正文，返回写入的字节数，0表示正文结束，-1表示出错
+    // 没有结束时至少写入1字节，len大于0
+    virtual int read(char *buf, int len) = 0;
+};
+
+// 已经生成好的正文，如统计信息，内容不多，只是借用分块发送，不用再单独处理正文的生命周期
+class string_source : public chunk_source
+{
+public:
+    explicit string_source(std::string text) : m_text(std::move(text)), m_pos(0) {}
+
+    int read(char *buf, int len) override
+    {
+        size_t n = m_text.size() - m_pos;
+        if (n > (size_t)len)
+            n = len;
+        memcpy(buf, m_text.data() + m_pos, n);
+        m_pos += n;
+        return (int)n;
+    }
+
+private:
+    std::string m_text;
+    size_t m_pos;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cctype>
+#include <cstring>
+
+#include "dir_listing.h"
+
+// 每次从目录读出的项数，生成的html交出去之后再读下一批
+static const int FILL_ENTRIES = 32;
+
+// 文件名放进html之前转义
+static void append_html(std::string &out, const char *text)
+{
+    for (const char *p = text; *p; ++p)
+    {
+        switch (*p)
+        {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        case '\'':
+            out += "&#39;";
+            break;
+        default:
+            out += *p;
+        }
+    }
+}
+
+// 文件名放进链接之前按百分号编码，只保留不需要编码的字符
+static void append_url(std::string &out, const char *name)
+{
+    static const char *hex = "0123456789ABCDEF";
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p)
+    {
+        if (isalnum(*p) || '-' == *p || '.' == *p || '_' == *p || '~' == *p)
+        {
+            out += *p;
+        }
+        else
+        {
+            out += '%';
+            out += hex[*p >> 4];
+            out += hex[*p & 0xf];
+        }
+    }
+}
+
+std::unique_ptr<dir_listing> dir_listing::open(const char *path, const char *url)
+{
+    DIR *dir = opendir(path);
+    if (!dir)
+        return nullptr;
+    return std::unique_ptr<dir_listing>(new dir_listing(dir, url));
+}
+
+dir_listing::dir_listing(DIR *dir, const char *url) : m_dir(dir), m_url(url), m_pos(0), m_done(false)
+{
+    if (m_url.empty() || m_url.back() != '/')
+        m_url += '/';
+    m_pending = "<html><head><meta charset=\"utf-8\"><title>Index of ";
+    append_html(m_pending, m_url.c_str());
+    m_pending += "</title></head>\n<body><h1>Index of ";
+    append_html(m_pending, m_url.c_str());
+    m_pending += "</h1><hr><ul>\n";
+    if (m_url != "/")
+        m_pending += "<li><a href=\"../\">../</a></li>\n";
+}
+
+dir_listing::~dir_listing()
+{
+    closedir(m_dir);
+}
+
+void dir_listing::add_entry(const char *name, bool is_dir)
+{
+    m_pending += "<li><a href=\"";
+    append_html(m_pending, m_url.c_str());
+    append_url(m_pending, name);
+    if (is_dir)
+        m_pending += '/';
+    m_pending += "\">";
+    append_html(m_pending, name);
+    if (is_dir)
+        m_pending += '/';
+    m_pending += "</a></li>\n";
+}
+
+bool dir_listing::fill()
+{
+    for (int i = 0; i < FILL_ENTRIES; ++i)
+    {
+        struct dirent *entry = readdir(m_dir);
+        if (!entry)
+        {
+            m_pending += "</ul><hr></body></html>\n";
+            m_done = true;
+            return false;
+        }
+        if ('.' == entry->d_name[0])
+            continue;
+        bool is_dir = DT_DIR == entry->d_type;
+        // 有的文件系统不提供d_type
+        if (DT_UNKNOWN == entry->d_type)
+        {
+            struct stat st;
+            is_dir = 0 == fstatat(dirfd(m_dir), entry->d_name, &st, 0) && S_ISDIR(st.st_mode);
+        }
+        add_entry(entry->d_name, is_dir);
+    }
+    return true;
+}
+
+int dir_listing::read(char *buf, int len)
+{
+    // 已经交出去的部分不再保留，m_pending只存一批目录项的html
+    if (m_pos == m_pending.size())
+    {
+        m_pending.clear();
+        m_pos = 0;
+        while (!m_done && m_pending.empty())
+            fill();
+        if (m_pending.empty())
+            return 0;
+    }
+    size_t n = m_pending.size() - m_pos;
+    if (n > (size_t)len)
+        n = len;
+    memcpy(buf, m_pending.data() + m_pos, n);
+    m_pos += n;
+    return (int)n;
+}
@@ -0,0 +1,35 @@
+#ifndef DIR_LISTING_H
+#define DIR_LISTING_H
+
+#include <dirent.h>
+#include <memory>
+#include <string>
+
+#include "chunk_source.h"
+
+// 目录的文件列表页面，边读目录边生成html，按readdir的顺序列出，不排序，隐藏文件不列出
+class dir_listing : public chunk_source
+{
+public:
+    // path为目录的完整路径，url为请求的路径，打不开目录时返回空
+    static std::unique_ptr<dir_listing> open(const char *path, const char *url);
+
+    ~dir_listing();
+
+    int read(char *buf, int len) override;
+
+private:
+    dir_listing(DIR *dir, const char *url);
+
+    void add_entry(const char *name, bool is_dir); // 一个目录项生成一行html追加到m_pending
+    bool fill();                                   // 读若干目录项，目录读完时追加页尾并返回false
+
+private:
+    DIR *m_dir;
+    std::string m_url;     // 以/结尾的请求路径，作为链接的前缀
+    std::string m_pending; // 已经生成、还没有交出去的html
+    size_t m_pos;          // m_pending中已经交出去的长度
+    bool m_done;           // 页尾已经生成
+};
+
+#endif
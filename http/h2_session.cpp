@@ -0,0 +1,836 @@
+#include <sys/mman.h>
+
+#include "h2_session.h"
+#include "http_conn.h"
+
+const char h2_session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// 帧类型
+enum FRAME_TYPE
+{
+    FRAME_DATA = 0,
+    FRAME_HEADERS,
+    FRAME_PRIORITY,
+    FRAME_RST_STREAM,
+    FRAME_SETTINGS,
+    FRAME_PUSH_PROMISE,
+    FRAME_PING,
+    FRAME_GOAWAY,
+    FRAME_WINDOW_UPDATE,
+    FRAME_CONTINUATION
+};
+
+// 帧标志
+enum FRAME_FLAG
+{
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20
+};
+
+// RST_STREAM和GOAWAY的错误码
+enum H2_ERROR
+{
+    H2_NO_ERROR = 0,
+    H2_PROTOCOL_ERROR = 1,
+    H2_INTERNAL_ERROR = 2,
+    H2_FLOW_CONTROL_ERROR = 3,
+    H2_STREAM_CLOSED = 5,
+    H2_FRAME_SIZE_ERROR = 6,
+    H2_REFUSED_STREAM = 7,
+    H2_COMPRESSION_ERROR = 9,
+    H2_ENHANCE_YOUR_CALM = 11
+};
+
+// SETTINGS的参数
+enum SETTINGS_ID
+{
+    SETTINGS_HEADER_TABLE_SIZE = 1,
+    SETTINGS_ENABLE_PUSH,
+    SETTINGS_MAX_CONCURRENT_STREAMS,
+    SETTINGS_INITIAL_WINDOW_SIZE,
+    SETTINGS_MAX_FRAME_SIZE,
+    SETTINGS_MAX_HEADER_LIST_SIZE
+};
+
+static const int64_t DEFAULT_WINDOW = 65535;
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void write_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void write_frame_header(uint8_t *p, uint32_t len, uint8_t type, uint8_t flags, uint32_t stream)
+{
+    p[0] = len >> 16;
+    p[1] = len >> 8;
+    p[2] = len;
+    p[3] = type;
+    p[4] = flags;
+    write_u32(p + 5, stream);
+}
+
+// HTTP2-Settings是base64url编码的SETTINGS帧负载，末尾可以有=
+static bool base64url_decode(const char *text, std::string &out)
+{
+    uint32_t bits = 0;
+    int cnt = 0;
+    for (const char *p = text; *p && *p != '='; ++p)
+    {
+        int v;
+        if (*p >= 'A' && *p <= 'Z')
+            v = *p - 'A';
+        else if (*p >= 'a' && *p <= 'z')
+            v = *p - 'a' + 26;
+        else if (*p >= '0' && *p <= '9')
+            v = *p - '0' + 52;
+        else if ('-' == *p)
+            v = 62;
+        else if ('_' == *p)
+            v = 63;
+        else
+            return false;
+        bits = bits << 6 | v;
+        cnt += 6;
+        if (cnt >= 8)
+        {
+            cnt -= 8;
+            out.push_back((char)(bits >> cnt));
+        }
+    }
+    return true;
+}
+
+h2_stream::h2_stream(uint32_t stream_id, int64_t initial_window)
+    : id(stream_id), window(initial_window), end_stream(false), address(nullptr), map_len(0), segment_idx(0)
+{
+}
+
+h2_stream::~h2_stream()
+{
+    if (address)
+        munmap(address, map_len);
+}
+
+h2_session::h2_session(http_conn *conn)
+    : m_conn(conn), m_preface(false), m_settings_sent(false), m_goaway(false), m_last_stream(0), m_next_stream(0),
+      m_header_stream(0), m_header_end_stream(false), m_window(DEFAULT_WINDOW), m_initial_window(DEFAULT_WINDOW),
+      m_max_frame(MAX_FRAME_SIZE), m_recv_consumed(0), m_close_log(conn->m_close_log)
+{
+}
+
+h2_session::~h2_session()
+{
+}
+
+void h2_session::write_frame(uint8_t type, uint8_t flags, uint32_t stream, const void *payload, uint32_t len)
+{
+    uint8_t header[FRAME_HEADER_SIZE];
+    write_frame_header(header, len, type, flags, stream);
+    m_conn->add_text((const char *)header, FRAME_HEADER_SIZE);
+    if (len > 0)
+        m_conn->add_text((const char *)payload, len);
+}
+
+// 服务器的连接前言，只限制并发流数和解码后请求头的大小，其余用默认值
+void h2_session::send_settings()
+{
+    uint8_t payload[12];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    write_u32(payload + 2, MAX_STREAMS);
+    payload[6] = 0;
+    payload[7] = SETTINGS_MAX_HEADER_LIST_SIZE;
+    write_u32(payload + 8, http_conn::MAX_HEADER_SIZE);
+    write_frame(FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+    m_settings_sent = true;
+}
+
+void h2_session::reset_stream(uint32_t stream, uint32_t error)
+{
+    uint8_t payload[4];
+    write_u32(payload, error);
+    write_frame(FRAME_RST_STREAM, 0, stream, payload, sizeof(payload));
+    close_stream(stream);
+}
+
+// 结束的流放到m_done，它的正文可能还在这一批的iovec里，这一批发送完再释放
+void h2_session::close_stream(uint32_t stream)
+{
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end())
+        return;
+    m_done.push_back(std::move(it->second));
+    m_streams.erase(it);
+}
+
+bool h2_session::goaway(uint32_t error)
+{
+    LOG_WARN("http2 connection error %u", error);
+    uint8_t payload[8];
+    write_u32(payload, m_last_stream);
+    write_u32(payload + 4, error);
+    write_frame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+    m_goaway = true;
+    return false;
+}
+
+bool h2_session::upgrade(const char *settings)
+{
+    std::string payload;
+    if (!base64url_decode(settings, payload) || payload.size() % 6 != 0)
+        return false;
+    // 101响应相当于确认了这些设置，不需要回复SETTINGS ACK
+    return 0 == apply_settings((const uint8_t *)payload.data(), payload.size());
+}
+
+void h2_session::upgrade_response(int ret)
+{
+    send_settings();
+    m_last_stream = 1;
+    h2_stream *s = new h2_stream(1, m_initial_window);
+    s->end_stream = true;
+    m_streams[1].reset(s);
+    respond(*s, ret);
+}
+
+const uint8_t *h2_session::frame_payload(int idx, uint32_t len)
+{
+    const int size = http_conn::READ_BUFFER_SIZE;
+    if (0 == len || idx / size == (int)(idx + len - 1) / size)
+        return (const uint8_t *)&m_conn->read_byte(idx);
+    m_frame.resize(len);
+    for (uint32_t copied = 0; copied < len;)
+    {
+        uint32_t n = size - (idx + copied) % size;
+        if (n > len - copied)
+            n = len - copied;
+        memcpy(&m_frame[copied], &m_conn->read_byte(idx + copied), n);
+        copied += n;
+    }
+    return (const uint8_t *)m_frame.data();
+}
+
+bool h2_session::process()
+{
+    http_conn &c = *m_conn;
+    if (!m_preface)
+    {
+        int avail = c.m_read_idx - c.m_checked_idx;
+        for (int i = 0; i < avail && i < PREFACE_LEN; ++i)
+        {
+            if (c.read_byte(c.m_checked_idx + i) != PREFACE[i])
+                return goaway(H2_PROTOCOL_ERROR);
+        }
+        if (avail < PREFACE_LEN)
+            return true;
+        c.m_checked_idx += PREFACE_LEN;
+        m_preface = true;
+        if (!m_settings_sent)
+            send_settings();
+    }
+
+    m_recv_consumed = 0;
+    while (c.m_read_idx - c.m_checked_idx >= FRAME_HEADER_SIZE)
+    {
+        uint8_t header[FRAME_HEADER_SIZE];
+        for (int i = 0; i < FRAME_HEADER_SIZE; ++i)
+            header[i] = c.read_byte(c.m_checked_idx + i);
+        uint32_t len = (uint32_t)header[0] << 16 | (uint32_t)header[1] << 8 | header[2];
+        if (len > MAX_FRAME_SIZE)
+            return goaway(H2_FRAME_SIZE_ERROR);
+        if (c.m_read_idx - c.m_checked_idx < (int)(FRAME_HEADER_SIZE + len))
+            break;
+        const uint8_t *payload = frame_payload(c.m_checked_idx + FRAME_HEADER_SIZE, len);
+        c.m_checked_idx += FRAME_HEADER_SIZE + len;
+        if (!handle_frame(header[3], header[4], read_u32(header + 5) & 0x7fffffff, payload, len))
+            return false;
+    }
+
+    // 收到的DATA已经处理完，一次还给连接窗口
+    if (m_recv_consumed > 0)
+    {
+        uint8_t payload[4];
+        write_u32(payload, m_recv_consumed);
+        write_frame(FRAME_WINDOW_UPDATE, 0, 0, payload, sizeof(payload));
+    }
+    return true;
+}
+
+bool h2_session::handle_frame(uint8_t type, uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    // 头部块没收完时只能收到同一个流的CONTINUATION
+    if (m_header_stream && (type != FRAME_CONTINUATION || stream != m_header_stream))
+        return goaway(H2_PROTOCOL_ERROR);
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        return on_data(flags, stream, payload, len);
+    case FRAME_HEADERS:
+        return on_headers(flags, stream, payload, len);
+    case FRAME_CONTINUATION:
+    {
+        if (!m_header_stream)
+            return goaway(H2_PROTOCOL_ERROR);
+        if (m_header_block.size() + len > (size_t)http_conn::MAX_HEADER_SIZE)
+            return goaway(H2_ENHANCE_YOUR_CALM);
+        m_header_block.append((const char *)payload, len);
+        if (flags & FLAG_END_HEADERS)
+            return end_headers();
+        return true;
+    }
+    // 不支持优先级，按轮转发送
+    case FRAME_PRIORITY:
+        return true;
+    case FRAME_RST_STREAM:
+    {
+        if (0 == stream)
+            return goaway(H2_PROTOCOL_ERROR);
+        if (len != 4)
+            return goaway(H2_FRAME_SIZE_ERROR);
+        close_stream(stream);
+        return true;
+    }
+    case FRAME_SETTINGS:
+        return on_settings(flags, stream, payload, len);
+    // 客户端不能推送
+    case FRAME_PUSH_PROMISE:
+        return goaway(H2_PROTOCOL_ERROR);
+    case FRAME_PING:
+    {
+        if (stream != 0)
+            return goaway(H2_PROTOCOL_ERROR);
+        if (len != 8)
+            return goaway(H2_FRAME_SIZE_ERROR);
+        if (!(flags & FLAG_ACK))
+            write_frame(FRAME_PING, FLAG_ACK, 0, payload, len);
+        return true;
+    }
+    // 对方要关闭连接，已经打开的流继续发送完
+    case FRAME_GOAWAY:
+    {
+        m_goaway = true;
+        return true;
+    }
+    case FRAME_WINDOW_UPDATE:
+        return on_window_update(stream, payload, len);
+    // 不认识的帧类型忽略
+    default:
+        return true;
+    }
+}
+
+bool h2_session::on_data(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    if (0 == stream)
+        return goaway(H2_PROTOCOL_ERROR);
+    m_recv_consumed += len;
+
+    uint32_t pad = 0;
+    if (flags & FLAG_PADDED)
+    {
+        if (0 == len || payload[0] >= len)
+            return goaway(H2_PROTOCOL_ERROR);
+        pad = payload[0] + 1;
+    }
+
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end() || it->second->end_stream)
+    {
+        if (stream > m_last_stream)
+            return goaway(H2_PROTOCOL_ERROR);
+        if (it != m_streams.end())
+            reset_stream(stream, H2_STREAM_CLOSED);
+        return true;
+    }
+    h2_stream &s = *it->second;
+    if (s.body.size() + len - pad > (size_t)http_conn::MAX_CONTENT_LENGTH)
+    {
+        reset_stream(stream, H2_REFUSED_STREAM);
+        return true;
+    }
+    s.body.append((const char *)payload + (pad ? 1 : 0), len - pad);
+    if (flags & FLAG_END_STREAM)
+    {
+        s.end_stream = true;
+        dispatch(s);
+    }
+    // 请求体还没收完，还给流的接收窗口
+    else if (len > 0)
+    {
+        uint8_t update[4];
+        write_u32(update, len);
+        write_frame(FRAME_WINDOW_UPDATE, 0, stream, update, sizeof(update));
+    }
+    return true;
+}
+
+bool h2_session::on_headers(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    if (0 == stream || !(stream & 1))
+        return goaway(H2_PROTOCOL_ERROR);
+
+    // 去掉填充和优先级
+    uint32_t pad = 0;
+    if (flags & FLAG_PADDED)
+    {
+        if (0 == len)
+            return goaway(H2_PROTOCOL_ERROR);
+        pad = payload[0];
+        ++payload;
+        --len;
+    }
+    if (flags & FLAG_PRIORITY)
+    {
+        if (len < 5)
+            return goaway(H2_PROTOCOL_ERROR);
+        payload += 5;
+        len -= 5;
+    }
+    if (pad > len)
+        return goaway(H2_PROTOCOL_ERROR);
+    len -= pad;
+
+    m_header_block.assign((const char *)payload, len);
+    m_header_stream = stream;
+    m_header_end_stream = flags & FLAG_END_STREAM;
+    if (flags & FLAG_END_HEADERS)
+        return end_headers();
+    return true;
+}
+
+bool h2_session::end_headers()
+{
+    uint32_t id = m_header_stream;
+    m_header_stream = 0;
+
+    // 动态表要和对方保持一致，被拒绝的流的头部块也要解码
+    // 解码后的大小和HTTP/1.1的请求头用同一个上限，超过时动态表已经不完整，只能关闭连接
+    header_list headers;
+    hpack::DECODE_RESULT res = m_hpack.decode((const uint8_t *)m_header_block.data(), m_header_block.size(), headers,
+                                              http_conn::MAX_HEADER_SIZE);
+    if (hpack::DECODE_TOO_LARGE == res)
+        return goaway(H2_ENHANCE_YOUR_CALM);
+    if (res != hpack::DECODE_OK)
+        return goaway(H2_COMPRESSION_ERROR);
+
+    // 已经打开的流又收到头部块是请求体后面的trailer，内容忽略
+    auto it = m_streams.find(id);
+    if (it != m_streams.end())
+    {
+        h2_stream &s = *it->second;
+        if (s.end_stream || !m_header_end_stream)
+        {
+            reset_stream(id, H2_PROTOCOL_ERROR);
+            return true;
+        }
+        s.end_stream = true;
+        dispatch(s);
+        return true;
+    }
+    if (id <= m_last_stream)
+        return goaway(H2_STREAM_CLOSED);
+    m_last_stream = id;
+
+    if (m_goaway || m_streams.size() >= (size_t)MAX_STREAMS)
+    {
+        reset_stream(id, H2_REFUSED_STREAM);
+        return true;
+    }
+    h2_stream *s = new h2_stream(id, m_initial_window);
+    s->headers = std::move(headers);
+    s->end_stream = m_header_end_stream;
+    m_streams[id].reset(s);
+    if (s->end_stream)
+        dispatch(*s);
+    return true;
+}
+
+bool h2_session::on_settings(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    if (stream != 0)
+        return goaway(H2_PROTOCOL_ERROR);
+    if (flags & FLAG_ACK)
+        return 0 == len ? true : goaway(H2_FRAME_SIZE_ERROR);
+    if (len % 6 != 0)
+        return goaway(H2_FRAME_SIZE_ERROR);
+    uint32_t error = apply_settings(payload, len);
+    if (error)
+        return goaway(error);
+    write_frame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    return true;
+}
+
+// 只关心初始窗口和帧大小；头部表大小不用管，响应头编码不用动态表
+uint32_t h2_session::apply_settings(const uint8_t *payload, uint32_t len)
+{
+    for (uint32_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = (uint16_t)(payload[i] << 8 | payload[i + 1]);
+        uint32_t value = read_u32(payload + i + 2);
+        switch (id)
+        {
+        case SETTINGS_ENABLE_PUSH:
+        {
+            if (value > 1)
+                return H2_PROTOCOL_ERROR;
+            break;
+        }
+        // 初始窗口的变化作用到所有打开的流上
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+                return H2_FLOW_CONTROL_ERROR;
+            int64_t delta = (int64_t)value - m_initial_window;
+            for (auto &item : m_streams)
+            {
+                item.second->window += delta;
+                if (item.second->window > MAX_WINDOW)
+                    return H2_FLOW_CONTROL_ERROR;
+            }
+            m_initial_window = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+        {
+            if (value < MAX_FRAME_SIZE || value > 0xffffff)
+                return H2_PROTOCOL_ERROR;
+            m_max_frame = value;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return H2_NO_ERROR;
+}
+
+bool h2_session::on_window_update(uint32_t stream, const uint8_t *payload, uint32_t len)
+{
+    if (len != 4)
+        return goaway(H2_FRAME_SIZE_ERROR);
+    uint32_t increment = read_u32(payload) & 0x7fffffff;
+    if (0 == stream)
+    {
+        if (0 == increment)
+            return goaway(H2_PROTOCOL_ERROR);
+        m_window += increment;
+        if (m_window > MAX_WINDOW)
+            return goaway(H2_FLOW_CONTROL_ERROR);
+        return true;
+    }
+    // 已经结束的流可能还会收到WINDOW_UPDATE
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end())
+        return true;
+    it->second->window += increment;
+    if (0 == increment)
+        reset_stream(stream, H2_PROTOCOL_ERROR);
+    else if (it->second->window > MAX_WINDOW)
+        reset_stream(stream, H2_FLOW_CONTROL_ERROR);
+    return true;
+}
+
+// 把请求头填到http_conn里，和HTTP/1.1一样由set_request_line和do_request处理
+void h2_session::dispatch(h2_stream &s)
+{
+    static char version[] = "HTTP/1.1";
+    http_conn &c = *m_conn;
+    c.next_request();
+
+    std::string *method = nullptr;
+    std::string *path = nullptr;
+    bool bad = false;
+    for (auto &field : s.headers)
+    {
+        if (":method" == field.first)
+            method = &field.second;
+        else if (":path" == field.first)
+            path = &field.second;
+        else if (':' == field.first[0])
+            continue;
+        else if (c.parse_header(field.first, &field.second[0]) == http_conn::BAD_REQUEST)
+            bad = true;
+    }
+
+    int ret = http_conn::BAD_REQUEST;
+    if (!bad && method && path && !path->empty())
+    {
+        // set_request_line在路径为/时原地追加judge.html，先留出位置
+        path->append(sizeof("judge.html"), '\0');
+        c.m_url = &(*path)[0];
+        c.m_version = version;
+        if (c.set_request_line(&(*method)[0]) != http_conn::BAD_REQUEST)
+        {
+            LOG_INFO("h2 stream %u: %s %s", s.id, method->c_str(), c.m_url);
+            if (c.m_cgi)
+            {
+                c.m_content_length = s.body.size();
+                c.m_content = &s.body[0];
+            }
+            ret = c.do_request();
+        }
+    }
+    respond(s, ret);
+}
+
+void h2_session::respond(h2_stream &s, int ret)
+{
+    http_conn &c = *m_conn;
+    std::string block;
+    char value[128];
+
+    switch (ret)
+    {
+    case http_conn::FILE_REQUEST:
+    {
+        // 正文的所有权从连接转到流，流结束后释放
+        char *address = nullptr;
+        off_t offset = 0;
+        if (c.m_cache_entry)
+        {
+            s.cache_entry = std::move(c.m_cache_entry);
+            address = const_cast<char *>(s.cache_entry->body.data());
+        }
+        else if (c.m_file_address && c.m_file_address != MAP_FAILED)
+        {
+            address = s.address = c.m_file_address;
+            s.map_len = c.m_file_map_len;
+            offset = c.m_file_map_offset;
+        }
+        c.m_file_address = nullptr;
+
+        if (0 == c.m_range_cnt)
+        {
+            hpack::encode_status(block, 200);
+            hpack::encode_literal(block, hpack::CONTENT_LENGTH, std::to_string((long long)c.m_file_stat.st_size));
+            hpack::encode_literal(block, hpack::CONTENT_TYPE, c.m_content_type);
+            if (address && c.m_file_stat.st_size > 0)
+                s.segments.push_back({address, (size_t)c.m_file_stat.st_size});
+        }
+        else if (1 == c.m_range_cnt)
+        {
+            const http_conn::byte_range &range = c.m_ranges[0];
+            hpack::encode_status(block, 206);
+            snprintf(value, sizeof(value), "bytes %lld-%lld/%lld", (long long)range.first, (long long)range.last,
+                     (long long)c.m_file_stat.st_size);
+            hpack::encode_literal(block, hpack::CONTENT_RANGE, value);
+            hpack::encode_literal(block, hpack::CONTENT_LENGTH, std::to_string((long long)(range.last - range.first + 1)));
+            hpack::encode_literal(block, hpack::CONTENT_TYPE, c.m_content_type);
+            s.segments.push_back({address + (range.first - offset), (size_t)(range.last - range.first + 1)});
+        }
+        // 多段范围的分段头先全部写到extra，再让各段指向它，避免extra扩容后地址失效
+        else
+        {
+            std::vector<std::pair<size_t, size_t>> parts;
+            char part[256];
+            for (int i = 0; i < c.m_range_cnt; ++i)
+            {
+                int n = c.range_part_header(part, sizeof(part), i);
+                parts.push_back({s.extra.size(), (size_t)n});
+                s.extra.append(part, n);
+            }
+            int n = snprintf(part, sizeof(part), "\r\n--%s--\r\n", http_conn::RANGE_BOUNDARY);
+            size_t tail = s.extra.size();
+            s.extra.append(part, n);
+            size_t content_len = s.extra.size();
+            for (int i = 0; i < c.m_range_cnt; ++i)
+            {
+                const http_conn::byte_range &range = c.m_ranges[i];
+                s.segments.push_back({&s.extra[parts[i].first], parts[i].second});
+                s.segments.push_back({address + (range.first - offset), (size_t)(range.last - range.first + 1)});
+                content_len += range.last - range.first + 1;
+            }
+            s.segments.push_back({&s.extra[tail], (size_t)n});
+            hpack::encode_status(block, 206);
+            snprintf(value, sizeof(value), "multipart/byteranges; boundary=%s", http_conn::RANGE_BOUNDARY);
+            hpack::encode_literal(block, hpack::CONTENT_TYPE, value);
+            hpack::encode_literal(block, hpack::CONTENT_LENGTH, std::to_string(content_len));
+        }
+        if (c.m_content_encoding != ENCODING_IDENTITY)
+            hpack::encode_literal(block, hpack::CONTENT_ENCODING, compressor::encoding_name(c.m_content_encoding));
+        if (c.m_vary)
+            hpack::encode_literal(block, hpack::VARY, "accept-encoding");
+        hpack::encode_literal(block, hpack::ETAG, c.m_validator.etag);
+        hpack::encode_literal(block, hpack::LAST_MODIFIED, c.m_validator.last_modified);
+        if (http_conn::m_cache_control[0] != '\0')
+            hpack::encode_literal(block, hpack::CACHE_CONTROL, http_conn::m_cache_control);
+        hpack::encode_literal(block, hpack::ACCEPT_RANGES, "bytes");
+        break;
+    }
+    case http_conn::NOT_MODIFIED:
+    {
+        hpack::encode_status(block, 304);
+        if (c.m_content_encoding != ENCODING_IDENTITY)
+            hpack::encode_literal(block, hpack::CONTENT_ENCODING, compressor::encoding_name(c.m_content_encoding));
+        if (c.m_vary)
+            hpack::encode_literal(block, hpack::VARY, "accept-encoding");
+        hpack::encode_literal(block, hpack::ETAG, c.m_validator.etag);
+        hpack::encode_literal(block, hpack::LAST_MODIFIED, c.m_validator.last_modified);
+        if (http_conn::m_cache_control[0] != '\0')
+            hpack::encode_literal(block, hpack::CACHE_CONTROL, http_conn::m_cache_control);
+        break;
+    }
+    case http_conn::RANGE_NOT_SATISFIABLE:
+    {
+        hpack::encode_status(block, 416);
+        snprintf(value, sizeof(value), "bytes */%lld", (long long)c.m_file_stat.st_size);
+        hpack::encode_literal(block, hpack::CONTENT_RANGE, value);
+        break;
+    }
+    // 生成的正文不需要Content-Length，DATA帧本身有长度，END_STREAM表示结束
+    case http_conn::CHUNKED_REQUEST:
+    {
+        hpack::encode_status(block, 200);
+        hpack::encode_literal(block, hpack::CONTENT_TYPE, c.m_content_type);
+        s.source = std::move(c.m_chunk_source);
+        break;
+    }
+    default:
+    {
+        int status = 0;
+        s.extra = http_conn::error_page((http_conn::HTTP_CODE)ret, status);
+        hpack::encode_status(block, status);
+        hpack::encode_literal(block, hpack::CONTENT_LENGTH, std::to_string(s.extra.size()));
+        s.segments.push_back({&s.extra[0], s.extra.size()});
+        break;
+    }
+    }
+    c.m_cache_entry.reset();
+
+    bool has_body = !s.segments.empty() || s.source;
+    write_frame(FRAME_HEADERS, FLAG_END_HEADERS | (has_body ? 0 : FLAG_END_STREAM), s.id, block.data(), block.size());
+    if (!has_body)
+        close_stream(s.id);
+}
+
+bool h2_session::sendable(const h2_stream &s) const
+{
+    return (s.segment_idx < s.segments.size() || s.source) && s.window > 0 && m_window > 0;
+}
+
+bool h2_session::want_write() const
+{
+    if (!m_preface)
+        return false;
+    for (auto &item : m_streams)
+    {
+        if (sendable(*item.second))
+            return true;
+    }
+    return false;
+}
+
+// 文件正文:帧头写到写缓冲区，负载是指向正文的iovec，可能跨越多段
+// 生成的正文:直接生成到写缓冲区帧头的后面，结束时发一个空的带END_STREAM的DATA帧
+int h2_session::send_data(h2_stream &s)
+{
+    http_conn &c = *m_conn;
+    int64_t limit = s.window < m_window ? s.window : m_window;
+    if (limit > (int64_t)MAX_FRAME_SIZE)
+        limit = MAX_FRAME_SIZE;
+    if (limit > (int64_t)m_max_frame)
+        limit = m_max_frame;
+
+    uint8_t header[FRAME_HEADER_SIZE];
+    uint32_t n = 0;
+    bool last = false;
+    if (s.segment_idx < s.segments.size())
+    {
+        size_t left = 0;
+        for (size_t i = s.segment_idx; i < s.segments.size(); ++i)
+            left += s.segments[i].iov_len;
+        n = left < (size_t)limit ? left : limit;
+        last = n == left && !s.source;
+        write_frame_header(header, n, FRAME_DATA, last ? FLAG_END_STREAM : 0, s.id);
+        c.add_text((const char *)header, FRAME_HEADER_SIZE);
+        for (uint32_t left = n; left > 0;)
+        {
+            struct iovec &seg = s.segments[s.segment_idx];
+            size_t len = seg.iov_len < left ? seg.iov_len : left;
+            c.add_iovec((char *)seg.iov_base, len);
+            seg.iov_base = (char *)seg.iov_base + len;
+            seg.iov_len -= len;
+            left -= len;
+            if (0 == seg.iov_len)
+                ++s.segment_idx;
+        }
+    }
+    else
+    {
+        int space = 0;
+        char *buf = c.write_space(space);
+        // 当前块剩下的空间太小，跳到下一块
+        if (space < FRAME_HEADER_SIZE + 64)
+        {
+            c.m_write_idx += space;
+            buf = c.write_space(space);
+        }
+        if (limit > space - FRAME_HEADER_SIZE)
+            limit = space - FRAME_HEADER_SIZE;
+        int ret = s.source->read(buf + FRAME_HEADER_SIZE, (int)limit);
+        if (ret < 0)
+        {
+            LOG_ERROR("h2 stream %u: chunked response aborted", s.id);
+            reset_stream(s.id, H2_INTERNAL_ERROR);
+            return FRAME_HEADER_SIZE + 4;
+        }
+        n = ret;
+        last = 0 == n;
+        if (last)
+            s.source.reset();
+        write_frame_header((uint8_t *)buf, n, FRAME_DATA, last ? FLAG_END_STREAM : 0, s.id);
+        c.m_write_idx += FRAME_HEADER_SIZE + n;
+        c.add_iovec(buf, FRAME_HEADER_SIZE + n);
+    }
+
+    s.window -= n;
+    m_window -= n;
+    if (last)
+        close_stream(s.id);
+    return FRAME_HEADER_SIZE + n;
+}
+
+// 从上次发送的流后面开始，每个流一次一帧，直到这一批满了或者没有可以发送的流
+// h2c升级后等收到客户端的连接前言再发送DATA，有的客户端切换协议前放不下紧跟在101后面的大量数据
+void h2_session::produce()
+{
+    if (!m_preface)
+        return;
+    int budget = BATCH;
+    bool progress = true;
+    while (budget > 0 && progress)
+    {
+        progress = false;
+        auto it = m_streams.upper_bound(m_next_stream);
+        for (size_t i = 0, cnt = m_streams.size(); i < cnt && budget > 0 && !m_streams.empty(); ++i)
+        {
+            if (it == m_streams.end())
+                it = m_streams.begin();
+            h2_stream &s = *it->second;
+            ++it; // send_data可能结束这个流，先移到下一个
+            if (!sendable(s))
+                continue;
+            m_next_stream = s.id;
+            budget -= send_data(s);
+            progress = true;
+        }
+    }
+}
+
+void h2_session::release()
+{
+    m_done.clear();
+}
@@ -0,0 +1,117 @@
+#ifndef H2_SESSION_H
+#define H2_SESSION_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hpack.h"
+#include "chunk_source.h"
+#include "../cache/file_cache.h"
+
+class http_conn;
+
+// HTTP/2的一个流，即一个请求和它的响应
+struct h2_stream
+{
+    uint32_t id;
+    int64_t window;      // 发送窗口，对方用WINDOW_UPDATE增加
+    header_list headers; // 请求头
+    std::string body;    // 请求体，只有登录和注册用到
+    bool end_stream;     // 对方已经发完请求
+
+    // 响应正文:依次发送segments，指向文件内容或extra；生成的正文由source分段生成
+    char *address;                                 // mmap映射的地址，命中缓存时为空
+    size_t map_len;                                // mmap映射的长度
+    std::shared_ptr<const file_entry> cache_entry; // 命中缓存时持有缓存项
+    std::string extra;                             // 多段范围请求的分段头、错误页面的正文
+    std::vector<struct iovec> segments;            // 还没有发送的正文
+    size_t segment_idx;                            // 第一个还没发送完的段
+    std::unique_ptr<chunk_source> source;          // 生成的正文，发完segments之后发送
+
+    h2_stream(uint32_t stream_id, int64_t initial_window);
+    ~h2_stream();
+};
+
+// 明文HTTP/2(h2c)连接，由http_conn在收到连接前言或h2c升级请求后创建
+// 解析读缓冲区里的帧，请求交给http_conn::do_request找文件，响应帧写到http_conn的写缓冲区
+// DATA帧的负载直接指向文件内容，写缓冲区里只有帧头；各个流轮流发送，一次一帧，受流和连接两级发送窗口限制
+// 窗口用完时回到读状态，收到WINDOW_UPDATE后继续；一批发送完毕后由http_conn::next_chunks接着生成下一批
+class h2_session
+{
+public:
+    static const int FRAME_HEADER_SIZE = 9;
+    static const uint32_t MAX_FRAME_SIZE = 16384; // 接收帧的大小上限，也是发送DATA帧的上限，使用默认值
+    static const int MAX_STREAMS = 100;           // 同时打开的流数上限，超过的流直接拒绝
+    static const int BATCH = 128 * 1024;          // 一批最多生成的DATA负载
+    static const int PREFACE_LEN = 24;
+    static const char PREFACE[];                  // 客户端的连接前言
+
+    explicit h2_session(http_conn *conn);
+    ~h2_session();
+
+    // h2c升级:settings是HTTP2-Settings字段，格式不对返回false，这时继续按HTTP/1.1响应
+    bool upgrade(const char *settings);
+    // 升级请求已经由do_request处理，ret是处理结果，作为流1的响应发送
+    void upgrade_response(int ret);
+
+    // 处理读缓冲区里完整的帧，控制帧和响应头写到写缓冲区
+    // 返回false表示连接出错，已经写入GOAWAY，发送完毕后关闭连接
+    bool process();
+
+    // 按发送窗口轮流为各个流生成DATA帧，最多BATCH字节
+    void produce();
+
+    // 还有窗口允许发送的正文
+    bool want_write() const;
+
+    // 写缓冲区已经全部发出，释放已经结束的流
+    void release();
+
+private:
+    bool handle_frame(uint8_t type, uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool on_data(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool on_headers(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool end_headers(); // 头部块收完，解码后打开流
+    bool on_settings(uint8_t flags, uint32_t stream, const uint8_t *payload, uint32_t len);
+    bool on_window_update(uint32_t stream, const uint8_t *payload, uint32_t len);
+    uint32_t apply_settings(const uint8_t *payload, uint32_t len); // 返回错误码，0表示成功
+
+    void dispatch(h2_stream &s);          // 请求收完，交给do_request
+    void respond(h2_stream &s, int ret);  // 按do_request的结果生成响应头，准备正文
+    int send_data(h2_stream &s);          // 发送一个DATA帧，返回写入写缓冲区的字节数
+    bool sendable(const h2_stream &s) const;
+
+    const uint8_t *frame_payload(int idx, uint32_t len); // 帧负载跨块时拷贝到m_frame
+    void write_frame(uint8_t type, uint8_t flags, uint32_t stream, const void *payload, uint32_t len);
+    void send_settings();
+    void reset_stream(uint32_t stream, uint32_t error);
+    void close_stream(uint32_t stream);
+    bool goaway(uint32_t error); // 写入GOAWAY，总是返回false
+
+private:
+    http_conn *m_conn;
+    hpack m_hpack;
+    std::map<uint32_t, std::unique_ptr<h2_stream>> m_streams; // 打开的流
+    std::vector<std::unique_ptr<h2_stream>> m_done;          // 已经结束的流，正文可能还在写缓冲区的iovec里
+    bool m_preface;          // 已经收到连接前言
+    bool m_settings_sent;    // 已经发送服务器的SETTINGS
+    bool m_goaway;           // 已经收到或发送GOAWAY，不再接受新的流
+    uint32_t m_last_stream;  // 对方打开过的最大流id
+    uint32_t m_next_stream;  // 上一次发送DATA的流，轮转从它后面开始
+    uint32_t m_header_stream; // 正在接收CONTINUATION的流，0表示没有
+    bool m_header_end_stream; // 正在接收的头部块带END_STREAM
+    std::string m_header_block;
+    int64_t m_window;          // 连接的发送窗口
+    int64_t m_initial_window;  // 对方的SETTINGS_INITIAL_WINDOW_SIZE，新流的发送窗口
+    uint32_t m_max_frame;      // 对方的SETTINGS_MAX_FRAME_SIZE
+    uint32_t m_recv_consumed;  // 本次收到的DATA字节数，处理完一起用WINDOW_UPDATE还给连接窗口
+    std::string m_frame;       // 跨块的帧负载
+    int m_close_log;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef HEADER_TABLE_HPP
+#define HEADER_TABLE_HPP
+
+#include <strings.h>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// 需要处理的请求头字段，新增字段只改这里，再在http_conn::parse_header里加一个case
+#define HTTP_HEADER_LIST(X)                   \
+    X(CONNECTION, "Connection")               \
+    X(CONTENT_LENGTH, "Content-Length")       \
+    X(HOST, "Host")                           \
+    X(IF_NONE_MATCH, "If-None-Match")         \
+    X(IF_MODIFIED_SINCE, "If-Modified-Since") \
+    X(RANGE, "Range")                         \
+    X(IF_RANGE, "If-Range")                   \
+    X(ACCEPT_ENCODING, "Accept-Encoding")     \
+    X(UPGRADE, "Upgrade")                     \
+    X(HTTP2_SETTINGS, "HTTP2-Settings")
+
+enum HEADER_ID : uint8_t
+{
+    HEADER_UNKNOWN = 0,
+#define HEADER_ENUM(id, name) HEADER_##id,
+    HTTP_HEADER_LIST(HEADER_ENUM)
+#undef HEADER_ENUM
+    HEADER_COUNT
+};
+
+// 字段名按下标HEADER_ID排列
+inline constexpr std::string_view HEADER_NAMES[HEADER_COUNT] = {
+    "",
+#define HEADER_NAME(id, name) name,
+    HTTP_HEADER_LIST(HEADER_NAME)
+#undef HEADER_NAME
+};
+
+// 不区分大小写的FNV-1a，字母统一转成小写，'-'和数字|0x20后不变
+constexpr uint32_t header_hash(uint32_t seed, std::string_view name)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : name)
+    {
+        h ^= (uint8_t)(c | 0x20);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 槽数取不小于字段数两倍的2的幂，取模只需要一次与运算
+constexpr uint32_t header_slot_count()
+{
+    uint32_t n = 16;
+    while (n < 2 * HEADER_COUNT)
+        n <<= 1;
+    return n;
+}
+
+inline constexpr uint32_t HEADER_SLOTS = header_slot_count();
+
+// 编译期依次尝试种子，直到所有字段名落在不同的槽里
+constexpr uint32_t header_seed()
+{
+    for (uint32_t seed = 1; seed < (1u << 16); ++seed)
+    {
+        bool used[HEADER_SLOTS] = {};
+        bool ok = true;
+        for (int id = 1; id < HEADER_COUNT && ok; ++id)
+        {
+            uint32_t slot = header_hash(seed, HEADER_NAMES[id]) & (HEADER_SLOTS - 1);
+            ok = !used[slot];
+            used[slot] = true;
+        }
+        if (ok)
+            return seed;
+    }
+    return 0;
+}
+
+inline constexpr uint32_t HEADER_SEED = header_seed();
+static_assert(HEADER_SEED != 0, "no perfect hash seed for HTTP_HEADER_LIST");
+
+// 槽 -> HEADER_ID，空槽为HEADER_UNKNOWN
+constexpr std::array<uint8_t, HEADER_SLOTS> header_slots()
+{
+    std::array<uint8_t, HEADER_SLOTS> slots = {};
+    for (int id = 1; id < HEADER_COUNT; ++id)
+        slots[header_hash(HEADER_SEED, HEADER_NAMES[id]) & (HEADER_SLOTS - 1)] = id;
+    return slots;
+}
+
+inline constexpr std::array<uint8_t, HEADER_SLOTS> HEADER_SLOT_TABLE = header_slots();
+
+// 请求头字段名 -> HEADER_ID，一次哈希加一次比较，不认识的字段返回HEADER_UNKNOWN
+inline HEADER_ID lookup_header(std::string_view name)
+{
+    HEADER_ID id = (HEADER_ID)HEADER_SLOT_TABLE[header_hash(HEADER_SEED, name) & (HEADER_SLOTS - 1)];
+    std::string_view known = HEADER_NAMES[id];
+    if (id != HEADER_UNKNOWN && known.size() == name.size() && strncasecmp(known.data(), name.data(), name.size()) == 0)
+        return id;
+    return HEADER_UNKNOWN;
+}
+
+#endif
@@ -0,0 +1,344 @@
+#include <cstdio>
+
+#include "hpack.h"
+
+// 静态表(RFC 7541附录A)，下标从1开始
+static const std::pair<const char *, const char *> STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+static const size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// Huffman编码(RFC 7541附录B)是范式Huffman码:按(码长,符号)排序后依次编号
+// 只需要每个符号的码长，码字在编译期算出来，最后一个是EOS
+static constexpr uint8_t HUFFMAN_LENGTHS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+static const int HUFFMAN_MAX_LENGTH = 30;
+
+// 每种码长的第一个码字、码字个数，以及该码长的第一个符号在symbols中的位置
+struct huffman_table
+{
+    uint32_t first[HUFFMAN_MAX_LENGTH + 1];
+    uint16_t count[HUFFMAN_MAX_LENGTH + 1];
+    uint16_t offset[HUFFMAN_MAX_LENGTH + 1];
+    uint16_t symbols[257]; // 按(码长,符号)排序
+};
+
+static constexpr huffman_table build_huffman()
+{
+    huffman_table table = {};
+    for (int sym = 0; sym < 257; ++sym)
+        ++table.count[HUFFMAN_LENGTHS[sym]];
+    uint32_t code = 0;
+    uint16_t offset = 0;
+    for (int len = 1; len <= HUFFMAN_MAX_LENGTH; ++len)
+    {
+        code = (code + table.count[len - 1]) << 1;
+        table.first[len] = code;
+        table.offset[len] = offset;
+        for (int sym = 0; sym < 257; ++sym)
+        {
+            if (HUFFMAN_LENGTHS[sym] == len)
+                table.symbols[offset++] = sym;
+        }
+    }
+    return table;
+}
+
+static constexpr huffman_table HUFFMAN = build_huffman();
+static_assert(HUFFMAN.first[5] == 0 && HUFFMAN.first[30] == 0x3ffffffc, "not the HPACK huffman code");
+
+// 逐位解码，码长到了某个长度、码字落在该长度的范围内就是一个符号
+// 结尾不足一个字节的填充必须是EOS的前缀，即全1且少于8位
+bool hpack::huffman_decode(const uint8_t *data, size_t len, std::string &out)
+{
+    uint32_t code = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int shift = 7; shift >= 0; --shift)
+        {
+            code = (code << 1) | ((data[i] >> shift) & 1);
+            ++bits;
+            uint32_t idx = code - HUFFMAN.first[bits];
+            if (idx < HUFFMAN.count[bits])
+            {
+                uint16_t sym = HUFFMAN.symbols[HUFFMAN.offset[bits] + idx];
+                if (256 == sym)
+                    return false;
+                out.push_back((char)sym);
+                code = 0;
+                bits = 0;
+            }
+            else if (bits == HUFFMAN_MAX_LENGTH)
+            {
+                return false;
+            }
+        }
+    }
+    return bits < 8 && code == (1u << bits) - 1;
+}
+
+void hpack::encode_int(std::string &out, uint8_t first, int prefix, size_t value)
+{
+    size_t max = (1u << prefix) - 1;
+    if (value < max)
+    {
+        out.push_back((char)(first | value));
+        return;
+    }
+    out.push_back((char)(first | max));
+    value -= max;
+    while (value >= 128)
+    {
+        out.push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool hpack::decode_int(const uint8_t *&p, const uint8_t *end, int prefix, size_t &value)
+{
+    if (p == end)
+        return false;
+    size_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if (value < max)
+        return true;
+    for (int shift = 0; p < end && shift <= 28; shift += 7)
+    {
+        uint8_t b = *p++;
+        value += (size_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool hpack::decode_string(const uint8_t *&p, const uint8_t *end, std::string &out)
+{
+    if (p == end)
+        return false;
+    bool huffman = *p & 0x80;
+    size_t len = 0;
+    if (!decode_int(p, end, 7, len) || len > (size_t)(end - p))
+        return false;
+    const uint8_t *data = p;
+    p += len;
+    if (huffman)
+        return huffman_decode(data, len, out);
+    out.assign((const char *)data, len);
+    return true;
+}
+
+void hpack::encode_indexed(std::string &out, int index)
+{
+    encode_int(out, 0x80, 7, index);
+}
+
+void hpack::encode_status(std::string &out, int status)
+{
+    switch (status)
+    {
+    case 200:
+        return encode_indexed(out, STATUS_200);
+    case 206:
+        return encode_indexed(out, STATUS_206);
+    case 304:
+        return encode_indexed(out, STATUS_304);
+    case 404:
+        return encode_indexed(out, STATUS_404);
+    case 500:
+        return encode_indexed(out, STATUS_500);
+    default:
+    {
+        // 状态码总是三位数
+        if (status < 100 || status > 999)
+            status = 500;
+        char value[3] = {(char)('0' + status / 100), (char)('0' + status / 10 % 10), (char)('0' + status % 10)};
+        encode_literal(out, STATUS_200, std::string_view(value, sizeof(value)));
+    }
+    }
+}
+
+void hpack::encode_literal(std::string &out, int name_index, std::string_view value)
+{
+    encode_int(out, 0x00, 4, name_index);
+    encode_int(out, 0x00, 7, value.size());
+    out.append(value.data(), value.size());
+}
+
+bool hpack::lookup(size_t index, std::string &name, std::string *value)
+{
+    if (0 == index)
+        return false;
+    if (index <= STATIC_TABLE_SIZE)
+    {
+        name = STATIC_TABLE[index - 1].first;
+        if (value)
+            *value = STATIC_TABLE[index - 1].second;
+        return true;
+    }
+    index -= STATIC_TABLE_SIZE + 1;
+    if (index >= m_table.size())
+        return false;
+    name = m_table[index].first;
+    if (value)
+        *value = m_table[index].second;
+    return true;
+}
+
+void hpack::evict(size_t max_size)
+{
+    while (m_size > max_size)
+    {
+        m_size -= m_table.back().first.size() + m_table.back().second.size() + 32;
+        m_table.pop_back();
+    }
+}
+
+// 比上限还大的字段不加入，但会清空动态表
+void hpack::insert(const std::string &name, const std::string &value)
+{
+    size_t size = name.size() + value.size() + 32;
+    if (size > m_max_size)
+    {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    m_table.emplace_front(name, value);
+    m_size += size;
+}
+
+hpack::DECODE_RESULT hpack::decode(const uint8_t *data, size_t len, header_list &headers, size_t max_list_size)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
+    bool field_seen = false;
+    size_t list_size = 0;
+    while (p < end)
+    {
+        uint8_t b = *p;
+        // 动态表大小更新，只能出现在头部块开头
+        if ((b & 0xe0) == 0x20)
+        {
+            size_t size = 0;
+            if (field_seen || !decode_int(p, end, 5, size) || size > MAX_TABLE_SIZE)
+                return DECODE_ERROR;
+            m_max_size = size;
+            evict(size);
+            continue;
+        }
+        field_seen = true;
+
+        std::string name, value;
+        // 完整字段在表里
+        if (b & 0x80)
+        {
+            size_t index = 0;
+            if (!decode_int(p, end, 7, index) || !lookup(index, name, &value))
+                return DECODE_ERROR;
+            list_size += name.size() + value.size() + 32;
+            if (list_size > max_list_size)
+                return DECODE_TOO_LARGE;
+            headers.emplace_back(std::move(name), std::move(value));
+            continue;
+        }
+
+        // 字面量:01为加入动态表，0000为不加入，0001为永不加入，字段名可以是表的下标或字面量
+        bool indexing = b & 0x40;
+        size_t index = 0;
+        if (!decode_int(p, end, indexing ? 6 : 4, index))
+            return DECODE_ERROR;
+        if (index ? !lookup(index, name, nullptr) : !decode_string(p, end, name))
+            return DECODE_ERROR;
+        if (!decode_string(p, end, value))
+            return DECODE_ERROR;
+        list_size += name.size() + value.size() + 32;
+        if (list_size > max_list_size)
+            return DECODE_TOO_LARGE;
+        if (indexing)
+            insert(name, value);
+        headers.emplace_back(std::move(name), std::move(value));
+    }
+    return DECODE_OK;
+}
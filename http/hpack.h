@@ -0,0 +1,81 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, std::string>> header_list;
+
+// HPACK头部压缩(RFC 7541)
+// 解码支持静态表、动态表和Huffman编码，每个连接一个，字段必须按收到的顺序解码
+// 编码只用静态表的下标和不加入动态表的字面量，不用Huffman，响应头不多，换来编码简单、不需要同步对方的表
+class hpack
+{
+public:
+    static const size_t MAX_TABLE_SIZE = 4096; // 动态表大小上限，即SETTINGS_HEADER_TABLE_SIZE的默认值
+
+    // 响应用到的静态表下标
+    enum STATIC_INDEX
+    {
+        STATUS_200 = 8,
+        STATUS_206 = 10,
+        STATUS_304 = 11,
+        STATUS_404 = 13,
+        STATUS_500 = 14,
+        ACCEPT_RANGES = 18,
+        CACHE_CONTROL = 24,
+        CONTENT_ENCODING = 26,
+        CONTENT_LENGTH = 28,
+        CONTENT_RANGE = 30,
+        CONTENT_TYPE = 31,
+        ETAG = 34,
+        LAST_MODIFIED = 44,
+        VARY = 59
+    };
+
+    // decode的结果，出错时动态表已经和对方不一致，都是连接错误
+    enum DECODE_RESULT
+    {
+        DECODE_OK = 0,
+        DECODE_ERROR,    // 格式错误
+        DECODE_TOO_LARGE // 解码后的字段超过大小上限
+    };
+
+    hpack() : m_size(0), m_max_size(MAX_TABLE_SIZE) {}
+
+    // 解码一个完整的头部块，字段依次追加到headers
+    // 解码后每个字段按名字和值的长度加32计算，总和超过max_list_size时停止，
+    // 防止很小的头部块靠引用动态表展开成大量数据
+    DECODE_RESULT decode(const uint8_t *data, size_t len, header_list &headers, size_t max_list_size);
+
+    // 静态表中的完整字段
+    static void encode_indexed(std::string &out, int index);
+    // :status，静态表里没有的状态码用字段名的下标加字面值
+    static void encode_status(std::string &out, int status);
+    // 字段名用静态表下标，值是字面量，不加入动态表
+    static void encode_literal(std::string &out, int name_index, std::string_view value);
+
+    // Huffman解码，出错返回false
+    static bool huffman_decode(const uint8_t *data, size_t len, std::string &out);
+
+private:
+    static void encode_int(std::string &out, uint8_t first, int prefix, size_t value);
+    static bool decode_int(const uint8_t *&p, const uint8_t *end, int prefix, size_t &value);
+    static bool decode_string(const uint8_t *&p, const uint8_t *end, std::string &out);
+
+    bool lookup(size_t index, std::string &name, std::string *value); // 下标从1开始，先静态表后动态表
+    void insert(const std::string &name, const std::string &value);   // 新字段加在动态表开头
+    void evict(size_t max_size);                                      // 从末尾淘汰到不超过max_size
+
+private:
+    std::deque<std::pair<std::string, std::string>> m_table; // 动态表，最新的在前
+    size_t m_size;                                           // 动态表大小，每个字段按名字和值的长度加32计算
+    size_t m_max_size;                                       // 对方通过大小更新设置的上限
+};
+
+#endif
@@ -1,7 +1,14 @@
 #include "http_conn.h"
+#include "../threadpool/threadpool.hpp"
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 
 // 定义http响应的一些状态信息
 const char *ok_200_title = "OK";
+const char *partial_206_title = "Partial Content";
+const char *not_modified_304_title = "Not Modified";
+const char *error_416_title = "Range Not Satisfiable";
 const char *error_400_title = "Bad Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
 const char *error_403_title = "Forbidden";
@@ -12,11 +19,16 @@ const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
 map<string, string> m_users_map; // 数据库里面已经有的用户密码
+set<string> m_registering;       // 正在写数据库的用户名，防止同名的注册同时通过检查
+shared_mutex m_users_lock;       // 保护上面两个，数据库通道的多个线程同时注册，登录只读
 Utils m_utils;                   // 工具类
 
-// 下面两个是static变量
-int http_conn::m_user_count = 0;
-int http_conn::m_epollfd = -1;
+// static变量
+std::atomic<int> http_conn::m_user_count(0);
+int http_conn::m_send_mode = 0;
+char http_conn::m_cache_control[32] = "";
+int http_conn::m_autoindex = 0;
+threadpool<http_conn> *http_conn::m_thread_pool = nullptr;
 
 // 将数据库中的用户名和密码载入到服务器的map中来
 void http_conn::init_mysql_result(connection_pool *connPool)
@@ -49,15 +61,15 @@ void http_conn::init_mysql_result(connection_pool *connPool)
     }
 }
 
-// 关闭连接，关闭一个连接，客户总量减一
+// 关闭连接
+// 工作线程不直接close:fd关掉后可能马上被别的reactor复用，而旧定时器还挂在原reactor的链表上
+// 这里只shutdown，由负责该连接的reactor收到EPOLLHUP后关闭fd、删除定时器并减少客户总量
 void http_conn::close_conn(bool real_close)
 {
     if (real_close && (m_sockfd != -1))
     {
         printf("close %d\n", m_sockfd);
-        m_utils.removefd(m_epollfd, m_sockfd);
-        m_sockfd = -1;
-        m_user_count--;
+        shutdown(m_sockfd, SHUT_RDWR);
     }
 }
 
@@ -66,6 +78,8 @@ void http_conn::close_conn(bool real_close)
  * 
  * @param sockfd 分配的客户fd 
  * @param address 客户地址
+ * @param epollfd 负责该连接的epoll，io_uring模式为-1
+ * @param completions 工作线程把处理结果交回事件循环的完成队列，Reactor和io_uring模式使用，否则为空
  * @param root 根目录地址
  * @param trigger_mode 客户fd的触发模式
  * @param close_log 是否关闭日志
@@ -73,20 +87,33 @@ void http_conn::close_conn(bool real_close)
  * @param passwd 数据库密码
  * @param sql_name 数据库名字
  */
-void http_conn::init(int sockfd, const sockaddr_in &address, char *root, int trigger_mode, int close_log,
-                     const string &user, const string &passwd, const string &sql_name)
+void http_conn::init(int sockfd, const sockaddr_in &address, int epollfd, completion_queue<http_conn> *completions,
+                     char *root, int trigger_mode, int close_log, const string &user, const string &passwd, const string &sql_name)
 {
     m_sockfd = sockfd;
     m_address = address;
-
-    m_utils.addfd(m_epollfd, sockfd, true, m_trigger_mode);
-    m_user_count++;
+    m_epollfd = epollfd;
+    m_completions = completions;
 
     // 当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     m_doc_root = root;
     m_trigger_mode = trigger_mode;
     m_close_log = close_log;
 
+    // 该fd上一个连接可能在发送文件的中途被关闭，先释放它的映射或文件
+    unmap();
+
+    // 流水线请求分成几批发送时，后一批不用等前一批的ACK(Nagle算法)
+    int nodelay = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    // 触发模式要先于注册事件赋值，io_uring模式下不注册epoll，socket保持阻塞
+    if (m_epollfd != -1)
+    {
+        m_utils.addfd(m_epollfd, sockfd, true, m_trigger_mode);
+    }
+    m_user_count++;
+
     strcpy(m_sql_user, user.c_str());
     strcpy(m_sql_passwd, passwd.c_str());
     strcpy(m_sql_name, sql_name.c_str());
@@ -97,9 +124,6 @@ void http_conn::init(int sockfd, const sockaddr_in &address, char *root, int tri
 // 初始化新接受的连接
 void http_conn::init()
 {
-    m_mysql = nullptr;
-    m_bytes_to_send = 0;
-    m_bytes_have_send = 0;
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_keep_alive = false;
     m_method = GET;
@@ -107,20 +131,144 @@ void http_conn::init()
     m_version = nullptr;
     m_content_length = 0;
     m_host = nullptr;
+    m_if_none_match = nullptr;
+    m_if_modified_since = nullptr;
+    m_range = nullptr;
+    m_if_range = nullptr;
+    m_range_cnt = 0;
+    m_accept_encoding = 0;
+    m_upgrade = nullptr;
+    m_http2_settings = nullptr;
+    m_h2.reset();
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
-    m_write_idx = 0;
+    m_request_start = 0;
     m_cgi = 0;
+    m_content = nullptr;
+    m_deferred = nullptr;
     m_io_state = 0; // 默认读状态的请求
-    timer_flag = 0;
-    improv = 0;
+    init_write();
+    free_read_buf();
+    m_lines.clear();
 
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
+// 一批响应发送完毕，写缓冲区的块还回池里；读缓冲区在process()结束时已经整理过，不用重置
+void http_conn::init_write()
+{
+    m_bytes_to_send = 0;
+    m_bytes_have_send = 0;
+    buffer_pool::get_instance()->put_all(m_write_chunks);
+    m_write_idx = 0;
+    m_iovec.clear();
+    m_iovec_idx = 0;
+    m_resp_cnt = 0;
+    m_linger = false;
+}
+
+// 流水线:上一个请求的响应已经生成，从m_checked_idx开始解析下一个请求
+void http_conn::next_request()
+{
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_keep_alive = false;
+    m_method = GET;
+    m_url = nullptr;
+    m_version = nullptr;
+    m_content_length = 0;
+    m_host = nullptr;
+    m_if_none_match = nullptr;
+    m_if_modified_since = nullptr;
+    m_range = nullptr;
+    m_if_range = nullptr;
+    m_range_cnt = 0;
+    m_accept_encoding = 0;
+    m_upgrade = nullptr;
+    m_http2_settings = nullptr;
+    m_cgi = 0;
+    m_content = nullptr;
+    m_start_line = m_checked_idx;
+    m_request_start = m_checked_idx;
+    m_lines.clear();
+    memset(m_real_file, '\0', FILENAME_LEN);
+}
+
+// 之前的请求都已经生成了响应，它们的数据不再需要
+// 数据全部处理完时把所有块还回去，空闲的长连接不占用读缓冲区
+// 否则只还当前请求之前的整块，块的位置不变，正在解析的请求里的指针不用调整
+void http_conn::compact_read_buf()
+{
+    if (m_request_start == m_read_idx)
+    {
+        free_read_buf();
+        return;
+    }
+    int drop = m_request_start / READ_BUFFER_SIZE;
+    if (0 == drop)
+        return;
+    for (int i = 0; i < drop; ++i)
+        buffer_pool::get_instance()->put(m_read_chunks[i]);
+    m_read_chunks.erase(m_read_chunks.begin(), m_read_chunks.begin() + drop);
+    int delta = drop * READ_BUFFER_SIZE;
+    m_read_idx -= delta;
+    m_checked_idx -= delta;
+    m_start_line -= delta;
+    m_request_start -= delta;
+}
+
+void http_conn::free_read_buf()
+{
+    buffer_pool::get_instance()->put_all(m_read_chunks);
+    m_read_idx = 0;
+    m_checked_idx = 0;
+    m_start_line = 0;
+    m_request_start = 0;
+}
+
+// 已有的块都写满了就从内存池再取一块
+char *http_conn::read_space(int &len)
+{
+    return buffer_pool::get_instance()->space(m_read_chunks, m_read_idx, len);
+}
+
+// 行的结尾已经被parse_line改成了\0，整行在一块里直接返回块内的地址
+char *http_conn::get_line()
+{
+    int end = m_checked_idx; // 行尾\0\0的下一个位置
+    if (m_start_line / READ_BUFFER_SIZE == (end - 1) / READ_BUFFER_SIZE)
+        return &read_byte(m_start_line);
+
+    // 跨块的行拷贝出来，请求头一般不会这么长，拷贝的代价可以忽略
+    m_lines.emplace_back();
+    std::string &line = m_lines.back();
+    line.reserve(end - m_start_line);
+    for (int i = m_start_line; i < end; ++i)
+        line.push_back(read_byte(i));
+    return &line[0];
+}
+
+// 消息体可能跨越多块，用到时才拼接成连续的字符串
+char *http_conn::get_content()
+{
+    if (!m_content)
+    {
+        int start = m_checked_idx - m_content_length;
+        m_content_buf.clear();
+        for (int i = start; i < m_checked_idx;)
+        {
+            int offset = i % READ_BUFFER_SIZE;
+            int n = READ_BUFFER_SIZE - offset;
+            if (n > m_checked_idx - i)
+                n = m_checked_idx - i;
+            m_content_buf.append(&read_byte(i), n);
+            i += n;
+        }
+        m_content = &m_content_buf[0];
+    }
+    return m_content;
+}
+
 // 从状态机：分析出一行内容
 // HTTP报文中，每一行的数据由\r\n作为结束字符，空行就是只有字符\r\n
 http_conn::LINE_STATUS http_conn::parse_line()
@@ -128,7 +276,7 @@ http_conn::LINE_STATUS http_conn::parse_line()
     char temp;
     for (; m_checked_idx < m_read_idx; ++m_checked_idx)
     {
-        temp = m_read_buf[m_checked_idx];
+        temp = read_byte(m_checked_idx);
         // 找到\r,确认下一个是不是\n
         if (temp == '\r')
         {
@@ -136,10 +284,10 @@ http_conn::LINE_STATUS http_conn::parse_line()
             if ((m_checked_idx + 1) == m_read_idx)
                 return LINE_OPEN;
             // 解析到了\r\n,表示一行完整了，把结尾替换为\0\0
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
+            else if (read_byte(m_checked_idx + 1) == '\n')
             {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
+                read_byte(m_checked_idx++) = '\0';
+                read_byte(m_checked_idx++) = '\0';
                 return LINE_OK;
             }
             return LINE_BAD;
@@ -148,10 +296,10 @@ http_conn::LINE_STATUS http_conn::parse_line()
         // 有可能上一次m_read_idx读到了\r\n中间，导致\r\n被两次检查
         else if (temp == '\n')
         {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
+            if (m_checked_idx > 1 && read_byte(m_checked_idx - 1) == '\r')
             {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
+                read_byte(m_checked_idx - 1) = '\0';
+                read_byte(m_checked_idx++) = '\0';
                 return LINE_OK;
             }
             return LINE_BAD;
@@ -161,35 +309,41 @@ http_conn::LINE_STATUS http_conn::parse_line()
 }
 
 // 读取客户数据
+// 读缓冲区按块增长，当前请求缓存的数据超过请求头和请求体的上限时关闭连接
 bool http_conn::read()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)
+    if (m_read_idx - m_request_start >= MAX_HEADER_SIZE + MAX_CONTENT_LENGTH)
     {
         return false;
     }
 
     int bytes_read = 0; // 本次读取的字节数
+    int len = 0;        // 当前块剩余的空间
+    char *buf = nullptr;
 
     // connfd是LT模式
     if (0 == m_trigger_mode)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
+        buf = read_space(len);
+        bytes_read = recv(m_sockfd, buf, len, 0);
 
         if (bytes_read <= 0)
         {
             return false;
         }
+        m_read_idx += bytes_read;
 
         return true;
     }
     // connfd是ET模式，一次性读完
+    // 达到上限时剩下的数据留在socket里，处理完重新注册EPOLLIN时epoll_ctl会再次通知
     else
     {
-        while (true)
+        while (m_read_idx - m_request_start < MAX_HEADER_SIZE + MAX_CONTENT_LENGTH)
         {
             // 参数 -读取的fd -缓冲区的位置 -缓冲区大小 -flag
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            buf = read_space(len);
+            bytes_read = recv(m_sockfd, buf, len, 0);
             // 返回-1：有错误
             if (bytes_read == -1)
             {
@@ -211,6 +365,24 @@ bool http_conn::read()
     }
 }
 
+// io_uring模式下数据已经由内核收到缓冲区组里，拷贝到读缓冲区
+bool http_conn::append(const char *data, int len)
+{
+    if (m_read_idx - m_request_start + len > MAX_HEADER_SIZE + MAX_CONTENT_LENGTH)
+        return false;
+    while (len > 0)
+    {
+        int space = 0;
+        char *buf = read_space(space);
+        int n = len < space ? len : space;
+        memcpy(buf, data, n);
+        m_read_idx += n;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
 // 解析HTTP请求行:获得请求方法，目标URL,以及HTTP版本号
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 {
@@ -228,9 +400,28 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 
     // text:GET\0/index.html HTTP/1.1
 
+    // m_url此时跳过了第一个空格或\t字符，但不知道之后是否还有
+    // strspn:跳过匹配的字符串片段
+    m_url += strspn(m_url, " \t");
+
+    // text:/index.html HTTP/1.1
+
+    // 判断HTTP版本号
+    m_version = strpbrk(m_url, " \t");
+    if (!m_version)
+        return BAD_REQUEST;
+    *m_version++ = '\0';
+    m_version += strspn(m_version, " \t");
+
+    // text:/index.html\0HTTP/1.1
+
+    return set_request_line(text);
+}
+
+// 请求行的三个字段已经以\0分开，检查方法和版本，整理m_url
+http_conn::HTTP_CODE http_conn::set_request_line(char *method)
+{
     // 判断请求方式
-    char *method = text;
-    // 因为上面将第一个空格改为了\0，因此method为GET
     if (strcasecmp(method, "GET") == 0)
     {
         m_method = GET;
@@ -246,21 +437,6 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
         return BAD_REQUEST;
     }
 
-    // m_url此时跳过了第一个空格或\t字符，但不知道之后是否还有
-    // strspn:跳过匹配的字符串片段
-    m_url += strspn(m_url, " \t");
-
-    // text:/index.html HTTP/1.1
-
-    // 判断HTTP版本号
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version)
-        return BAD_REQUEST;
-    *m_version++ = '\0';
-    m_version += strspn(m_version, " \t");
-
-    // text:/index.html\0HTTP/1.1
-
     // 仅支持HTTP/1.1
     if (strcasecmp(m_version, "HTTP/1.1") != 0)
         return BAD_REQUEST;
@@ -309,50 +485,192 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
         return GET_REQUEST;
     }
 
-    // 解析请求头部connection字段
-    else if (strncasecmp(text, "Connection:", 11) == 0)
+    // 冒号前面是字段名，后面跳过空格或者\t是字段值
+    char *colon = strchr(text, ':');
+    if (!colon)
     {
-        text += 11;                  // 跳过文字
-        text += strspn(text, " \t"); // 跳过空格或者\t
+        LOG_INFO("oop! unknown request header: %s", text);
+        return NO_REQUEST;
+    }
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+    return parse_header(std::string_view(text, colon - text), value);
+}
+
+// 解析Accept-Encoding，返回接受的编码，q=0表示不接受
+static int parse_accept_encoding(const char *value)
+{
+    int accept = 0;
+    const char *p = value;
+    while (*p)
+    {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, " \t,;");
+        int encoding = ENCODING_IDENTITY;
+        if (4 == len && strncasecmp(p, "gzip", 4) == 0)
+            encoding = ENCODING_GZIP;
+        else if (2 == len && strncasecmp(p, "br", 2) == 0)
+            encoding = ENCODING_BR;
+        else if (1 == len && '*' == *p)
+            encoding = ENCODING_GZIP | ENCODING_BR;
+        p += len;
+
+        // 分号后面的参数只关心q值
+        const char *end = p + strcspn(p, ",");
+        bool refused = false;
+        for (const char *s = p; s + 1 < end; ++s)
+        {
+            if ((*s == 'q' || *s == 'Q') && s[1] == '=')
+            {
+                refused = strtod(s + 2, nullptr) <= 0;
+                break;
+            }
+        }
+        if (!refused)
+            accept |= encoding;
+        p = end;
+    }
+    return accept;
+}
 
+// 按字段名处理一个请求头，value以\0结尾
+// 字段名由header_table.hpp中编译期生成的完美哈希表分类，新增字段先加到HTTP_HEADER_LIST
+http_conn::HTTP_CODE http_conn::parse_header(std::string_view name, char *value)
+{
+    switch (lookup_header(name))
+    {
+    // 解析请求头部connection字段
+    case HEADER_CONNECTION:
+    {
         // TODO:keep-alive和优雅关闭连接有什么关系
-        if (strcasecmp(text, "keep-alive") == 0)
+        if (strcasecmp(value, "keep-alive") == 0)
         {
             m_keep_alive = true; //如果是长连接，则将linger标志设置为true
         }
+        break;
     }
-
     // 解析请求头部Content-length字段
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
+    case HEADER_CONTENT_LENGTH:
     {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text); // 请求数据的长度
+        m_content_length = atol(value); // 请求数据的长度
+        if (m_content_length < 0 || m_content_length > MAX_CONTENT_LENGTH)
+            return BAD_REQUEST;
+        break;
     }
-
     // 解析请求头部Host字段
-    else if (strncasecmp(text, "Host:", 5) == 0)
+    case HEADER_HOST:
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        m_host = value;
+        break;
     }
-    else
+    // 条件请求，在do_request中和文件的ETag、修改时间比较
+    case HEADER_IF_NONE_MATCH:
     {
-        LOG_INFO("oop! unknown request header: %s", text);
+        m_if_none_match = value;
+        break;
+    }
+    case HEADER_IF_MODIFIED_SINCE:
+    {
+        m_if_modified_since = value;
+        break;
+    }
+    // 压缩编码协商，在do_request中查找压缩版本
+    case HEADER_ACCEPT_ENCODING:
+    {
+        m_accept_encoding = parse_accept_encoding(value);
+        break;
+    }
+    // 范围请求，在do_request中按文件大小解析
+    case HEADER_RANGE:
+    {
+        m_range = value;
+        break;
+    }
+    case HEADER_IF_RANGE:
+    {
+        m_if_range = value;
+        break;
+    }
+    // h2c升级，在process()中处理
+    case HEADER_UPGRADE:
+    {
+        m_upgrade = value;
+        break;
+    }
+    case HEADER_HTTP2_SETTINGS:
+    {
+        m_http2_settings = value;
+        break;
+    }
+    default:
+        LOG_INFO("oop! unknown request header: %.*s: %s", (int)name.size(), name.data(), value);
     }
     return NO_REQUEST;
 }
 
+// 快速路径:当前请求的开头到已读数据的末尾在同一块里时，用http_scanner一次扫描出请求行和全部请求头
+// 各字段在读缓冲区里原地以\0结尾，和按行解析的结果一样
+// 返回true表示ret就是process_read的结果；返回false时交给按行解析的状态机，
+// 可能是请求头跨块、格式有误或者请求头太多，也可能请求头已经解析完，接下来按状态机解析消息体
+bool http_conn::scan_request(HTTP_CODE &ret)
+{
+    int chunk_end = (m_checked_idx / READ_BUFFER_SIZE + 1) * READ_BUFFER_SIZE;
+    int end = m_read_idx < chunk_end ? m_read_idx : chunk_end;
+    char *buf = &read_byte(m_checked_idx);
+    http_request_head head;
+    int n = http_scanner::parse_request(buf, end - m_checked_idx, head);
+    if (n < 0)
+    {
+        // 数据都在这一块里，只是还没收完，等下次收到数据后重新扫描
+        if (http_scanner::PARSE_PARTIAL == n && end == m_read_idx)
+        {
+            ret = NO_REQUEST;
+            return true;
+        }
+        return false;
+    }
+
+    // string_view指向buf，后面一个字符是空白或\r，改成\0
+    auto terminate = [buf](std::string_view field) {
+        char *p = buf + (field.data() - buf);
+        p[field.size()] = '\0';
+        return p;
+    };
+    char *method = terminate(head.method);
+    m_url = terminate(head.target);
+    m_version = terminate(head.version);
+    LOG_INFO("%s %s %s", method, m_url, m_version);
+    ret = set_request_line(method);
+    if (ret == BAD_REQUEST)
+        return true;
+    for (int i = 0; i < head.header_cnt; ++i)
+    {
+        ret = parse_header(head.headers[i].name, terminate(head.headers[i].value));
+        if (ret == BAD_REQUEST)
+            return true;
+    }
+
+    m_checked_idx += n;
+    m_start_line = m_checked_idx;
+    m_check_state = CHECK_STATE_HEADER;
+    if (m_content_length != 0)
+    {
+        m_check_state = CHECK_STATE_CONTENT;
+        return false;
+    }
+    ret = do_request();
+    return true;
+}
+
 // 解析HTTP请求的消息体
-// POST请求会保存请求体；GET请求只是检查有没有完全读完了
-http_conn::HTTP_CODE http_conn::parse_content(char *text)
+// 只检查有没有完全读完了，消息体可能跨越多块，do_request用到时再由get_content()拼接
+http_conn::HTTP_CODE http_conn::parse_content()
 {
     // 这个判断保证已经完整把整个请求数据部分都读进来了
     if (m_read_idx >= (m_content_length + m_checked_idx))
     {
-        text[m_content_length] = '\0';
-        m_content = text; // 把请求数据的内容存起来
+        // 跳过消息体，后面可能紧跟着下一个流水线请求
+        m_checked_idx += m_content_length;
         return GET_REQUEST;
     }
     return NO_REQUEST;
@@ -369,21 +687,38 @@ http_conn::HTTP_CODE http_conn::process_read()
 
     char *text = nullptr;
 
+    // 新请求的开头先尝试一次扫描整个请求头
+    if (m_check_state == CHECK_STATE_REQUESTLINE && m_checked_idx == m_request_start && m_checked_idx < m_read_idx &&
+        scan_request(ret))
+        return ret;
+
     // 从状态机解析(按行读取缓冲区数据并分析)
     // GET请求报文中，每一行都是\r\n作为结束
     // 仅用从状态机的状态((line_status = parse_line()) == LINE_OK)判断即可
     while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) ||
-           ((line_status = parse_line()) == LINE_OK))
+           (m_check_state != CHECK_STATE_CONTENT && (line_status = parse_line()) == LINE_OK))
     // POST请求报文中，消息体的末尾没有任何字符
     // 使用 主状态机 的状态 m_check_state == CHECK_STATE_CONTENT
     // 解析完消息体后，报文的完整解析就完成了，但此时主状态机的状态还是CHECK_STATE_CONTENT，还会再次进入循环
     // 增加了 && line_status == LINE_OK，并在完成消息体解析后，将line_status变量更改为LINE_OPEN，此时可以跳出循环
+    // 消息体不完整时不能再交给从状态机按行解析，否则m_checked_idx会越过消息体的起点，消息体和后面的流水线请求也会被改掉
     {
-        text = get_line();
+        // 消息体不按行解析，由parse_content按长度判断
+        if (m_check_state != CHECK_STATE_CONTENT)
+        {
+            // 请求头超过上限，返回错误后关闭连接
+            if (m_checked_idx - m_request_start > MAX_HEADER_SIZE)
+            {
+                m_keep_alive = false;
+                return BAD_REQUEST;
+            }
+
+            text = get_line();
 
-        m_start_line = m_checked_idx; // 更新已经解析的数据起点指针
+            m_start_line = m_checked_idx; // 更新已经解析的数据起点指针
 
-        LOG_INFO("%s", text);
+            LOG_INFO("%s", text);
+        }
 
         // 主状态机的三种状态转移
         switch (m_check_state)
@@ -414,7 +749,7 @@ http_conn::HTTP_CODE http_conn::process_read()
         // 请求消息体
         case CHECK_STATE_CONTENT:
         {
-            ret = parse_content(text);
+            ret = parse_content();
             // 完整解析GET请求后，跳转到报文响应函数
             if (ret == GET_REQUEST)
                 return do_request();
@@ -425,155 +760,286 @@ http_conn::HTTP_CODE http_conn::process_read()
             return INTERNAL_ERROR;
         }
     }
+
+    // 请求头超过上限还不完整，同样返回错误
+    if (m_check_state != CHECK_STATE_CONTENT && m_read_idx - m_request_start > MAX_HEADER_SIZE)
+    {
+        m_keep_alive = false;
+        return BAD_REQUEST;
+    }
     return NO_REQUEST;
 }
 
-// 解析是要请求文件，这个函数把文件路径准备好
-http_conn::HTTP_CODE http_conn::do_request()
+// 路由表，第一次用到时注册内置的路由
+router<http_conn::route> &http_conn::routes()
 {
-    strcpy(m_real_file, m_doc_root);
-    int len = strlen(m_doc_root);
+    static router<route> table = []() {
+        router<route> r;
+        r.add("/", {&http_conn::do_file, nullptr, false}, true); // 其余的请求都是静态文件
+        r.add("/0", {&http_conn::do_file, "/register.html", false});
+        r.add("/1", {&http_conn::do_file, "/log.html", false});
+        r.add("/2", {&http_conn::do_login, nullptr, false}, true); // 包括/2CGISQL.cgi，只查内存里的用户表
+        r.add("/3", {&http_conn::do_register, nullptr, true}, true); // 注册要写数据库
+        r.add("/5", {&http_conn::do_file, "/picture.html", false});
+        r.add("/6", {&http_conn::do_file, "/video.html", false});
+        r.add("/7", {&http_conn::do_file, "/fans.html", false});
+        r.add("/metrics", {&http_conn::do_metrics, nullptr, false});
+        return r;
+    }();
+    return table;
+}
 
-    // p是/所在的位置,根据/后面的字符判断是登录还是注册
-    const char *p = strrchr(m_url, '/');
-
-    // 2:登录校验  3:注册校验
-    // m_cgi表示此时是post
-    if (m_cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
-    {
-        // 根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-        // 登录
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2); // 拼接路径
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        // 将用户名和密码提取出来
-        // user=123&password=123
-        char name[100], password[100];
-        int i; // 这里的5就是跳过user=
-        for (i = 5; m_content[i] != '&'; ++i)
-            name[i - 5] = m_content[i];
-        name[i - 5] = '\0';
-
-        int j = 0; // 这里的10是跳过&password=
-        for (i = i + 10; m_content[i] != '\0'; ++i, ++j)
-            password[j] = m_content[i];
-        password[j] = '\0';
-
-        // 注册
-        if (*(p + 1) == '3')
-        {
-
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            // 没有重名的
-            if (m_users_map.find(name) == m_users_map.end())
-            {
-                m_http_lock.lock();
-                // 插入密码
-                // 新的密码
-                int res = mysql_query(m_mysql, sql_insert);
-                m_users_map.insert(pair<string, string>(name, password));
-                m_http_lock.unlock();
-                // 如果sql插入成功
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
-            }
-            // 有重名的
-            else
-            {
-                strcpy(m_url, "/registerError.html");
-            }
-        }
-        // 登录
-        else if (*(p + 1) == '2')
-        {
-            // 如果密码正确
-            if (m_users_map.find(name) != m_users_map.end() && m_users_map[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
-        }
+void http_conn::add_route(const char *path, route_handler handler, const char *file, bool prefix, bool blocking)
+{
+    routes().add(path, {handler, file, blocking}, prefix);
+}
+
+// 按路由表找到处理函数，由它把响应准备好
+// 会阻塞在数据库上的POST先记下路由，交给数据库通道之后再执行；HTTP/2的流在同一个连接上多路复用，仍在这里执行
+http_conn::HTTP_CODE http_conn::do_request()
+{
+    const route *r = routes().find(m_url);
+    if (!r)
+        return NO_RESOURCE;
+    if (r->blocking && m_cgi && !m_h2 && m_thread_pool && m_thread_pool->has_db_lane())
+    {
+        m_deferred = r;
+        return DEFERRED_REQUEST;
     }
+    return (this->*(r->handler))(r->file);
+}
+
+// 从请求体user=123&password=123中取出用户名和密码，超过缓冲区的部分截断，格式不对返回false
+static bool parse_account(const char *content, char *name, char *password, int len)
+{
+    if (strncmp(content, "user=", 5) != 0)
+        return false;
+    const char *p = content + 5;
+    int i = 0;
+    for (; *p && *p != '&'; ++p)
+        if (i < len - 1)
+            name[i++] = *p;
+    name[i] = '\0';
+
+    if (strncmp(p, "&password=", 10) != 0)
+        return false;
+    i = 0;
+    for (p += 10; *p; ++p)
+        if (i < len - 1)
+            password[i++] = *p;
+    password[i] = '\0';
+    return true;
+}
 
-    // 0:跳转注册页面,GET
-    if (*(p + 1) == '0')
+// 2:登录校验，POST的请求体是用户名和密码
+http_conn::HTTP_CODE http_conn::do_login(const char *)
+{
+    if (m_cgi != 1)
+        return do_file(nullptr);
+
+    char name[100], password[100];
+    if (!parse_account(get_content(), name, password, sizeof(name)))
+        return do_file("/logError.html");
+
+    // 如果密码正确
+    bool ok;
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        // 将网站目录和/register.html进行拼接，更新到m_real_file中
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        shared_lock<shared_mutex> lock(m_users_lock);
+        auto it = m_users_map.find(name);
+        ok = it != m_users_map.end() && it->second == password;
     }
+    return do_file(ok ? "/welcome.html" : "/logError.html");
+}
+
+// 3:注册校验，用户名没有重复时写入数据库
+http_conn::HTTP_CODE http_conn::do_register(const char *)
+{
+    if (m_cgi != 1)
+        return do_file(nullptr);
+
+    char name[100], password[100];
+    if (!parse_account(get_content(), name, password, sizeof(name)))
+        return do_file("/registerError.html");
 
-    // 1:跳转登录界面,GET
-    else if (*(p + 1) == '1')
+    // 有重名的，或者同名的注册正在进行；没有时先占住这个用户名，写数据库期间不持有锁
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        unique_lock<shared_mutex> lock(m_users_lock);
+        if (m_users_map.count(name) || !m_registering.insert(name).second)
+            return do_file("/registerError.html");
     }
 
-    // 5:显示图片页面,POST
-    else if (*(p + 1) == '5')
+    char sql_insert[256];
+    snprintf(sql_insert, sizeof(sql_insert), "INSERT INTO user(username, passwd) VALUES('%s', '%s')", name, password);
+
+    // 只有注册要写数据库，到这里才从连接池取连接，静态文件和登录请求不占用连接池
+    // 连接都被占用时在这里等待，注册一般在数据库通道的线程里，不影响其他请求；连接池是空的时取不到
+    int res = 1;
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        MYSQL *mysql = nullptr;
+        connectionRAII mysql_conn(&mysql, connection_pool::GetInstance());
+        if (mysql)
+            res = mysql_query(mysql, sql_insert);
     }
 
-    // 6:显示视频页面,POST
-    else if (*(p + 1) == '6')
+    // 插入成功才加入用户表，失败时放开用户名
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        unique_lock<shared_mutex> lock(m_users_lock);
+        m_registering.erase(name);
+        if (0 == res)
+            m_users_map.insert(pair<string, string>(name, password));
     }
 
-    // 7:显示关注页面,POST
-    else if (*(p + 1) == '7')
+    // 如果sql插入成功
+    return do_file(res ? "/registerError.html" : "/log.html");
+}
+
+// 运行统计，纯文本，每行一个指标
+http_conn::HTTP_CODE http_conn::do_metrics(const char *)
+{
+    file_cache *cache = file_cache::get_instance();
+    char text[1024];
+    int n = snprintf(text, sizeof(text),
+                     "connections %d\n"
+                     "cache_hits %ld\n"
+                     "cache_misses %ld\n"
+                     "cache_bytes %zu\n"
+                     "buffer_pool_idle_chunks %zu\n",
+                     m_user_count.load(), cache->hits(), cache->misses(), cache->size(), buffer_pool::get_instance()->idle());
+    if (m_thread_pool)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
+        threadpool<http_conn>::stats st = m_thread_pool->get_stats();
+        snprintf(text + n, sizeof(text) - n,
+                 "pool_workers %d\n"
+                 "pool_workers_min %d\n"
+                 "pool_workers_max %d\n"
+                 "pool_idle %d\n"
+                 "pool_queue_depth %d\n"
+                 "pool_queue_capacity %d\n"
+                 "pool_wait_avg_us %ld\n"
+                 "pool_wait_max_us %ld\n"
+                 "pool_tasks %ld\n"
+                 "pool_spawned %ld\n"
+                 "pool_retired %ld\n"
+                 "pool_db_workers %d\n"
+                 "pool_db_queue_depth %d\n"
+                 "pool_db_tasks %ld\n",
+                 st.workers, st.min_workers, st.max_workers, st.idle, st.queue_depth, st.capacity,
+                 st.wait_avg_us, st.wait_max_us, st.tasks, st.spawned, st.retired,
+                 st.db_workers, st.db_queue_depth, st.db_tasks);
     }
-    // 以上均不符合发送url实际请求的文件
-    else
+    m_chunk_source.reset(new string_source(text));
+    m_content_type = "text/plain; charset=utf-8";
+    m_vary = false;
+    m_content_encoding = ENCODING_IDENTITY;
+    return CHUNKED_REQUEST;
+}
+
+// 静态文件，url为空时就是请求的路径，否则是路由指定的页面
+http_conn::HTTP_CODE http_conn::do_file(const char *url)
+{
+    if (!url)
+        url = m_url;
+    strcpy(m_real_file, m_doc_root);
+    int len = strlen(m_doc_root);
+    strncpy(m_real_file + len, url, FILENAME_LEN - len - 1);
+    m_real_file[FILENAME_LEN - 1] = '\0';
+
+    // Content-Type按原文件的扩展名，可压缩的文件有.br/.gz版本时把m_real_file换成压缩文件
+    // 之后的缓存、条件请求、范围请求和发送都针对压缩文件
+    const mime_type &mime = find_mime(m_real_file);
+    m_content_type = mime.type;
+    m_vary = mime.compressible;
+    m_content_encoding = ENCODING_IDENTITY;
+    bool remembered = mime.compressible && m_accept_encoding && select_encoding();
+
+    // 命中缓存直接返回，不需要访问文件系统
+    m_cache_entry = file_cache::get_instance()->get(m_real_file);
+    if (m_cache_entry)
     {
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+        // 范围请求要用到文件大小
+        m_validator = m_cache_entry->validator;
+        m_file_stat.st_size = m_cache_entry->body.size();
+        HTTP_CODE ret = NOT_MODIFIED;
+        if (not_modified() || (ret = parse_range()) != FILE_REQUEST)
+        {
+            m_cache_entry.reset();
+            return ret;
+        }
+        return FILE_REQUEST;
     }
 
     // 通过stat获取请求资源文件信息，成功则将信息更新到m_file_stat结构体
     // 失败返回NO_RESOURCE状态，表示资源不存在
     if (stat(m_real_file, &m_file_stat) < 0)
+    {
+        // 记住的压缩文件被删掉了(压缩目录不在inotify监听范围内)，忘掉之后按原文件重新选择
+        if (remembered && m_content_encoding != ENCODING_IDENTITY)
+        {
+            strcpy(m_real_file, m_doc_root);
+            strncpy(m_real_file + len, url, FILENAME_LEN - len - 1);
+            m_real_file[FILENAME_LEN - 1] = '\0';
+            file_cache::get_instance()->remove_variants(m_real_file);
+            return do_file(url);
+        }
         return NO_RESOURCE;
+    }
 
     // 判断文件的权限，是否可读，不可读则返回FORBIDDEN_REQUEST状态
     if (!(m_file_stat.st_mode & S_IROTH))
         return FORBIDDEN_REQUEST;
 
-    // 判断文件类型，如果是目录，则返回BAD_REQUEST，表示请求报文有误
+    // 判断文件类型，如果是目录，开启了文件列表时边读目录边分块发送，否则返回BAD_REQUEST，表示请求报文有误
     if (S_ISDIR(m_file_stat.st_mode))
-        return BAD_REQUEST;
+    {
+        if (!m_autoindex || !(m_chunk_source = dir_listing::open(m_real_file, m_url)))
+            return BAD_REQUEST;
+        m_content_type = "text/html; charset=utf-8";
+        return CHUNKED_REQUEST;
+    }
+
+    // 浏览器缓存的文件没有修改过，不需要读取文件
+    m_validator.init(m_file_stat);
+    if (not_modified())
+        return NOT_MODIFIED;
+    HTTP_CODE ret = parse_range();
+    if (ret != FILE_REQUEST)
+        return ret;
+
+    // 可以缓存的文件读入缓存，之后的请求都会命中
+    m_cache_entry = file_cache::get_instance()->load(m_real_file, m_file_stat);
+    if (m_cache_entry)
+        return FILE_REQUEST;
 
-    // 以只读方式获取文件描述符，通过mmap将该文件映射到内存中
+    // 以只读方式获取文件描述符
     int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(nullptr, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // 大文件保留文件描述符，发送时由sendfile在内核中直接把文件拷贝到socket，不需要映射和缺页
+    // sendfile不能和writev合并，只有一批中的第一个响应可以用；多段范围请求的各段之间要插入分段头，也不用sendfile
+    // HTTP/2的正文要切成DATA帧，同样不用sendfile
+    if (1 == m_send_mode && m_file_stat.st_size >= SENDFILE_MIN_SIZE && 0 == m_resp_cnt && m_range_cnt <= 1 && fd >= 0 &&
+        !m_h2 && !h2_upgrade())
+    {
+        m_file_fd = fd;
+        m_file_offset = m_range_cnt ? m_ranges[0].first : 0;
+        return FILE_REQUEST;
+    }
+
+    // 通过mmap将该文件映射到内存中
+    // 范围请求只映射覆盖所有范围的部分，起点按页对齐，拖动视频进度条时不用映射整个文件
+    m_file_map_offset = 0;
+    m_file_map_len = m_file_stat.st_size;
+    if (m_range_cnt > 0)
+    {
+        off_t first = m_ranges[0].first, last = m_ranges[0].last;
+        for (int i = 1; i < m_range_cnt; ++i)
+        {
+            first = m_ranges[i].first < first ? m_ranges[i].first : first;
+            last = m_ranges[i].last > last ? m_ranges[i].last : last;
+        }
+        m_file_map_offset = first & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+        m_file_map_len = last + 1 - m_file_map_offset;
+    }
+    m_file_address = (char *)mmap(nullptr, m_file_map_len, PROT_READ, MAP_PRIVATE, fd, m_file_map_offset);
 
     // 避免文件描述符的浪费和占用
     close(fd);
@@ -582,14 +1048,264 @@ http_conn::HTTP_CODE http_conn::do_request()
     return FILE_REQUEST;
 }
 
-// 取消内存映射
+// 按浏览器接受的编码选择压缩版本，选中时把m_real_file换成压缩文件
+// 选择的结果记在文件缓存里，之后相同的请求不需要stat原文件和各个压缩文件，返回true表示用的是记住的结果
+bool http_conn::select_encoding()
+{
+    file_cache *cache = file_cache::get_instance();
+    file_variant variant;
+    uint64_t generation = 0;
+    if (cache->find_variant(m_real_file, m_accept_encoding, variant, generation))
+    {
+        m_content_encoding = variant.encoding;
+        if (m_content_encoding != ENCODING_IDENTITY)
+            strcpy(m_real_file, variant.path.c_str());
+        return true;
+    }
+
+    struct stat file_stat;
+    char path[FILENAME_LEN];
+    if (stat(m_real_file, &file_stat) < 0 || !S_ISREG(file_stat.st_mode) || !(file_stat.st_mode & S_IROTH))
+        return false;
+    variant.source = m_real_file;
+    variant.encoding = compressor::get_instance()->find(m_real_file, file_stat, m_accept_encoding, path, sizeof(path));
+    if (variant.encoding != ENCODING_IDENTITY)
+        variant.path = path;
+    cache->add_variant(m_real_file, m_accept_encoding, variant, generation);
+    m_content_encoding = variant.encoding;
+    if (m_content_encoding != ENCODING_IDENTITY)
+        strcpy(m_real_file, path);
+    return false;
+}
+
+// 解析Range，支持bytes=a-b、a-和-n(最后n字节)，多个范围用逗号分隔
+// 格式不对、范围太多或者If-Range和文件不一致时忽略Range，完整返回文件
+// 所有范围都超出文件时返回RANGE_NOT_SATISFIABLE
+http_conn::HTTP_CODE http_conn::parse_range()
+{
+    off_t size = m_file_stat.st_size;
+    int cnt = 0;
+    m_range_cnt = 0;
+    if (m_method != GET || !m_range || size <= 0 || strncasecmp(m_range, "bytes=", 6) != 0)
+        return FILE_REQUEST;
+
+    // If-Range可以是ETag或者Last-Modified，都要完全一致，弱ETag不算
+    if (m_if_range && strcmp(m_if_range, m_if_range[0] == '"' ? m_validator.etag : m_validator.last_modified) != 0)
+        return FILE_REQUEST;
+
+    const char *p = m_range + 6;
+    while (true)
+    {
+        p += strspn(p, " \t");
+        char *end = nullptr;
+        off_t first = 0, last = size - 1;
+        if (*p == '-')
+        {
+            // 后缀范围:最后n字节
+            long long n = strtoll(p + 1, &end, 10);
+            if (end == p + 1 || n < 0)
+                return FILE_REQUEST;
+            if (0 == n)
+                first = size;
+            else if (n < size)
+                first = size - n;
+        }
+        else
+        {
+            long long a = strtoll(p, &end, 10);
+            if (end == p || a < 0 || *end != '-')
+                return FILE_REQUEST;
+            first = a;
+            p = end + 1;
+            if (*p >= '0' && *p <= '9')
+            {
+                long long b = strtoll(p, &end, 10);
+                if (b < a)
+                    return FILE_REQUEST;
+                if (b < last)
+                    last = b;
+            }
+            else
+                end = (char *)p;
+        }
+        p = end + strspn(end, " \t");
+
+        // 起点超出文件的范围不满足，其余的记下来
+        if (first < size)
+        {
+            if (cnt == MAX_RANGES)
+                return FILE_REQUEST;
+            m_ranges[cnt].first = first;
+            m_ranges[cnt].last = last;
+            ++cnt;
+        }
+
+        if (*p == '\0')
+            break;
+        if (*p != ',')
+            return FILE_REQUEST;
+        ++p;
+    }
+    if (0 == cnt)
+        return RANGE_NOT_SATISFIABLE;
+    m_range_cnt = cnt;
+    return FILE_REQUEST;
+}
+
+// 多段范围请求中第i段的分段头，buf为空时只计算长度
+int http_conn::range_part_header(char *buf, int len, int i)
+{
+    return snprintf(buf, len, "\r\n--%s\r\nContent-Type:%s\r\nContent-Range:bytes %lld-%lld/%lld\r\n\r\n",
+                    RANGE_BOUNDARY, m_content_type, (long long)m_ranges[i].first, (long long)m_ranges[i].last, (long long)m_file_stat.st_size);
+}
+
+// If-None-Match优先，是逗号分隔的ETag列表或者*，弱校验W/前缀忽略
+// 没有If-None-Match时比较If-Modified-Since，文件修改时间不晚于它就是没有修改过
+// 只有GET请求生效，POST请求的页面总是完整返回
+bool http_conn::not_modified()
+{
+    if (m_method != GET)
+        return false;
+    if (m_if_none_match)
+    {
+        const char *p = m_if_none_match;
+        size_t etag_len = strlen(m_validator.etag);
+        while (*p)
+        {
+            p += strspn(p, " \t,");
+            if (*p == '*')
+                return true;
+            if (strncmp(p, "W/", 2) == 0)
+                p += 2;
+            size_t len = strcspn(p, " \t,");
+            if (len == etag_len && strncmp(p, m_validator.etag, len) == 0)
+                return true;
+            p += len;
+        }
+        return false;
+    }
+    if (m_if_modified_since)
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (!strptime(m_if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+            return false;
+        return m_validator.mtime <= timegm(&tm);
+    }
+    return false;
+}
+
+// 取消内存映射，sendfile方式则关闭文件，命中缓存则释放缓存项
 void http_conn::unmap()
 {
+    // 本批各个响应的正文
+    for (int i = 0; i < m_body_cnt; ++i)
+    {
+        if (m_bodies[i].cache_entry)
+            m_bodies[i].cache_entry.reset();
+        else
+            munmap(m_bodies[i].address, m_bodies[i].size);
+    }
+    m_body_cnt = 0;
+
+    // 以下是do_request准备好、还没有交给process_write的文件
+    // 缓存的内容不是映射出来的，只需要放掉引用
+    if (m_cache_entry)
+    {
+        m_cache_entry.reset();
+        m_file_address = nullptr;
+    }
     if (m_file_address)
     {
-        munmap(m_file_address, m_file_stat.st_size);
+        munmap(m_file_address, m_file_map_len);
         m_file_address = nullptr;
     }
+    if (m_file_fd != -1)
+    {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+
+    // 发送中途出错或者连接关闭时，分块响应剩下的正文不再生成
+    m_chunk_source.reset();
+
+    // HTTP/2已经结束的流
+    if (m_h2)
+        m_h2->release();
+}
+
+// 返回本次发送的字节数，失败返回-1并设置errno
+int http_conn::send_file()
+{
+    // MSG_MORE告诉内核后面还有数据，响应头不会单独成一个小报文，而是和文件开头合并发送
+    if (m_iovec_idx < (int)m_iovec.size())
+    {
+        struct msghdr msg;
+        memset(&msg, '\0', sizeof(msg));
+        int cnt = 0;
+        msg.msg_iov = send_iovec(cnt);
+        msg.msg_iovlen = cnt;
+        int ret = sendmsg(m_sockfd, &msg, MSG_MORE);
+        if (ret > 0)
+            advance_send(ret);
+        return ret;
+    }
+    ssize_t ret = sendfile(m_sockfd, m_file_fd, &m_file_offset, m_bytes_to_send);
+    // 文件在发送过程中被截断
+    if (0 == ret)
+    {
+        errno = EIO;
+        return -1;
+    }
+    if (ret > 0)
+    {
+        m_bytes_have_send += ret;
+        m_bytes_to_send -= ret;
+    }
+    return (int)ret;
+}
+
+// writev完成了bytes字节，跳过已经发完的iovec，发了一部分的iovec调整起始位置
+off_t http_conn::advance_send(int bytes)
+{
+    m_bytes_have_send += bytes;
+    m_bytes_to_send -= bytes;
+    while (bytes > 0 && m_iovec_idx < (int)m_iovec.size())
+    {
+        struct iovec &iov = m_iovec[m_iovec_idx];
+        if ((size_t)bytes < iov.iov_len)
+        {
+            iov.iov_base = (char *)iov.iov_base + bytes;
+            iov.iov_len -= bytes;
+            break;
+        }
+        bytes -= iov.iov_len;
+        ++m_iovec_idx;
+    }
+    if (0 == m_bytes_to_send && more_to_send())
+        next_chunks();
+    return m_bytes_to_send;
+}
+
+// 响应很多时iovec可能超过writev一次能接受的上限，剩下的等下一次发送
+struct iovec *http_conn::send_iovec(int &cnt)
+{
+    cnt = (int)m_iovec.size() - m_iovec_idx;
+    if (cnt > IOV_MAX)
+        cnt = IOV_MAX;
+    return m_iovec.data() + m_iovec_idx;
+}
+
+// io_uring模式:响应全部发送完毕
+bool http_conn::finish_send()
+{
+    unmap();
+    if (m_linger)
+    {
+        init_write();
+        return true;
+    }
+    return false;
 }
 
 // process_write把待发送的数据添加到自定义的HTTP缓冲区，随后注册epollout事件(可写)
@@ -597,29 +1313,41 @@ void http_conn::unmap()
 bool http_conn::write()
 {
     // 没有待发送的数据
+    // 先重置连接状态再通知，通知之后连接可能马上被其他线程处理
     if (m_bytes_to_send == 0)
     {
-        m_utils.modfd(m_epollfd, m_sockfd, EPOLLIN, m_trigger_mode);
         init();
+        notify(EPOLLIN);
         return true;
     }
     // 保证一次性发完
     // TODO:为啥这里没有区别ET或者LT模式
     while (true)
     {
-        // 调用分散写writev函数把状态行、消息头、空行和响应正文写到socket的发送缓冲区
-        // m_iv数组保存了报文和mmap映射到内存中的文件的地址
+        // 调用分散写writev函数把这一批响应的状态行、消息头、空行和响应正文一次写到socket的发送缓冲区
+        // m_iovec数组保存了报文和mmap映射到内存中的文件的地址
         // 返回正常发送字节数
+        // sendfile方式由send_file自己记录进度
         int writev_ret = 0;
-        // TODO:这里多次调用writev没问题吗
-        writev_ret = writev(m_sockfd, m_iovec, m_iovec_cnt);
+        if (m_file_fd != -1)
+        {
+            writev_ret = send_file();
+        }
+        else
+        {
+            int cnt = 0;
+            struct iovec *iov = send_iovec(cnt);
+            writev_ret = writev(m_sockfd, iov, cnt);
+            if (writev_ret > 0)
+                advance_send(writev_ret);
+        }
         if (writev_ret < 0)
         {
             // 判断缓冲区是否满了
             if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
                 // 重新注册写事件
-                m_utils.modfd(m_epollfd, m_sockfd, EPOLLOUT, m_trigger_mode);
+                notify(EPOLLOUT);
                 return true;
             }
             // 不是缓冲区得问题,取消内存映射
@@ -627,38 +1355,28 @@ bool http_conn::write()
             return false;
         }
 
-        m_bytes_have_send += writev_ret; // 更新已发送字节
-        m_bytes_to_send -= writev_ret;   // 更新未发送字节
-
-        //头部)的数据已发送完，发送第二个iovec数据
-        if (m_bytes_have_send >= m_iovec[0].iov_len)
-        {
-            m_iovec[0].iov_len = 0;
-            m_iovec[1].iov_base = m_file_address + (m_bytes_have_send - m_write_idx);
-            m_iovec[1].iov_len = m_bytes_to_send;
-        }
-
-        // 继续发送第一个iovec头部信息的数据
-        else
-        {
-            m_iovec[0].iov_base = m_write_buf + m_bytes_have_send;
-            // TODO:这里减去已发送的值可能越界,m_bytes_have_send是累加值，应该是减去writev_ret吧
-            m_iovec[0].iov_len = m_iovec[0].iov_len - m_bytes_have_send;
-        }
-
         // 判断条件，数据已全部发送完
         if (m_bytes_to_send <= 0)
         {
             unmap();
-            // 重置oneshot，重新监听可读事件
-            m_utils.modfd(m_epollfd, m_sockfd, EPOLLIN, m_trigger_mode);
 
-            // 浏览器的请求为长连接
-            if (m_keep_alive)
+            // 浏览器的请求为长连接，重置oneshot，重新监听可读事件
+            if (m_linger)
             {
-                init();
+                init_write();
+                if (!has_request())
+                {
+                    notify(EPOLLIN);
+                }
+                // 读缓冲区里还有这一批放不下的流水线请求，socket上不一定还有数据，不能等可读事件
+                // Reactor模式已经在工作线程里，直接接着解析；Proactor模式由主线程交给工作线程
+                else if (m_completions)
+                {
+                    process();
+                }
                 return true;
             }
+            // 短连接由调用者关闭
             else
                 return false;
         }
@@ -668,37 +1386,67 @@ bool http_conn::write()
 // add...系列函数最终都是调用这个函数操作指针
 bool http_conn::add_response(const char *format, ...)
 {
-    // 如果写入内容超出m_write_buf大小则报错
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
-
     // 定义可变参数列表
     va_list arg_list;
 
     // 将变量arg_list初始化为传入参数
     va_start(arg_list, format);
 
-    // 将数据format从可变参数列表写入缓冲区写，返回写入数据的长度
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-
-    // 如果写入的数据长度超过缓冲区剩余空间，则报错
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
+    // 先直接格式化到写缓冲区当前块的剩余空间，放得下就不用拷贝
+    int space = 0;
+    char *buf = write_space(space);
+    va_list arg_copy;
+    va_copy(arg_copy, arg_list);
+    int len = vsnprintf(buf, space, format, arg_copy);
+    va_end(arg_copy);
+    if (len < 0)
     {
         va_end(arg_list);
         return false;
     }
 
-    // 更新m_write_idx位置
-    m_write_idx += len;
+    if (len < space)
+    {
+        m_write_idx += len;
+        add_iovec(buf, len);
+        LOG_INFO("request:%.*s", len, buf);
+    }
+    // 当前块放不下，格式化到临时字符串再分段拷贝到后面的块
+    else
+    {
+        std::string text(len + 1, '\0');
+        vsnprintf(&text[0], len + 1, format, arg_list);
+        add_text(text.data(), len);
+        LOG_INFO("request:%s", text.c_str());
+    }
 
     // 清空可变参列表
     va_end(arg_list);
 
-    LOG_INFO("request:%s", m_write_buf);
-
     return true;
 }
 
+// 写缓冲区中可以继续写入的位置和长度，当前块写满了就从buffer_pool再取一块
+char *http_conn::write_space(int &len)
+{
+    return buffer_pool::get_instance()->space(m_write_chunks, m_write_idx, len);
+}
+
+void http_conn::add_text(const char *data, int len)
+{
+    while (len > 0)
+    {
+        int space = 0;
+        char *buf = write_space(space);
+        int n = len < space ? len : space;
+        memcpy(buf, data, n);
+        m_write_idx += n;
+        add_iovec(buf, n);
+        data += n;
+        len -= n;
+    }
+}
+
 // 添加状态行
 bool http_conn::add_status_line(int status, const char *title)
 {
@@ -712,15 +1460,26 @@ bool http_conn::add_headers(int content_len)
 }
 
 // 添加Content-Length，表示响应报文的长度
-bool http_conn::add_content_length(int content_len)
+bool http_conn::add_content_length(off_t content_len)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    return add_response("Content-Length:%lld\r\n", (long long)content_len);
 }
 
-// 添加文本类型，这里是html
+// 添加文件类型，由do_request按扩展名查表得到
 bool http_conn::add_content_type()
 {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_response("Content-Type:%s\r\n", m_content_type);
+}
+
+// 发送压缩版本时标明编码；可压缩的文件不管是否压缩都带Vary，中间的缓存按Accept-Encoding区分
+bool http_conn::add_encoding()
+{
+    if (m_content_encoding != ENCODING_IDENTITY &&
+        !add_response("Content-Encoding:%s\r\n", compressor::encoding_name(m_content_encoding)))
+        return false;
+    if (m_vary)
+        return add_response("%s", "Vary:Accept-Encoding\r\n");
+    return true;
 }
 
 // 添加连接状态，通知浏览器端是保持连接还是关闭
@@ -729,6 +1488,44 @@ bool http_conn::add_linger()
     return add_response("Connection:%s\r\n", m_keep_alive ? "keep-alive" : "close");
 }
 
+// 添加缓存校验字段，浏览器下次请求时带上If-None-Match和If-Modified-Since
+bool http_conn::add_validator()
+{
+    return add_response("ETag:%s\r\nLast-Modified:%s\r\n", m_validator.etag, m_validator.last_modified) &&
+           add_cache_control();
+}
+
+// 缓存命中的200响应ETag和Last-Modified已经在缓存的响应头里，只需要添加Cache-Control
+bool http_conn::add_cache_control()
+{
+    if (m_cache_control[0] != '\0')
+        return add_response("Cache-Control:%s\r\n", m_cache_control);
+    return true;
+}
+
+// 告诉浏览器可以用Range请求文件的一部分
+bool http_conn::add_accept_ranges()
+{
+    return add_response("%s", "Accept-Ranges:bytes\r\n");
+}
+
+// 单个范围用Content-Range标明位置，多个范围是multipart/byteranges，每段有自己的分段头
+bool http_conn::add_range_headers()
+{
+    if (1 == m_range_cnt)
+    {
+        const byte_range &range = m_ranges[0];
+        return add_response("Content-Range:bytes %lld-%lld/%lld\r\n", (long long)range.first, (long long)range.last,
+                            (long long)m_file_stat.st_size) &&
+               add_content_length(range.last - range.first + 1);
+    }
+    off_t content_len = snprintf(nullptr, 0, "\r\n--%s--\r\n", RANGE_BOUNDARY);
+    for (int i = 0; i < m_range_cnt; ++i)
+        content_len += range_part_header(nullptr, 0, i) + (m_ranges[i].last - m_ranges[i].first + 1);
+    return add_response("Content-Type:multipart/byteranges; boundary=%s\r\n", RANGE_BOUNDARY) &&
+           add_content_length(content_len);
+}
+
 // 添加空行
 bool http_conn::add_blank_line()
 {
@@ -741,8 +1538,114 @@ bool http_conn::add_content(const char *content)
     return add_response("%s", content);
 }
 
-// 根据process_read()的报文解析结果，向m_write_buf中写入响应报文
-// 内部涉及到add...系列函数，均是内部调用add_response函数
+// 追加一段待发送的数据，同一块里相邻的响应头和错误响应的正文合并成一个iovec
+void http_conn::add_iovec(char *base, size_t len)
+{
+    if (!m_iovec.empty() && (char *)m_iovec.back().iov_base + m_iovec.back().iov_len == base)
+    {
+        m_iovec.back().iov_len += len;
+    }
+    else
+    {
+        struct iovec iov;
+        iov.iov_base = base;
+        iov.iov_len = len;
+        m_iovec.push_back(iov);
+    }
+    m_bytes_to_send += len;
+}
+
+// 文件正文的所有权从m_file_address或m_cache_entry转到m_bodies，下一个请求可以继续使用它们
+// 范围请求只发送各个范围，多个范围之间插入写缓冲区里的分段头
+void http_conn::add_body(char *address, size_t size, off_t offset)
+{
+    response_body &body = m_bodies[m_body_cnt++];
+    body.address = address;
+    body.size = size;
+    body.cache_entry = std::move(m_cache_entry);
+    m_file_address = nullptr;
+    if (0 == m_range_cnt)
+    {
+        add_iovec(address, size);
+        return;
+    }
+    for (int i = 0; i < m_range_cnt; ++i)
+    {
+        if (m_range_cnt > 1)
+        {
+            char part[256];
+            add_text(part, range_part_header(part, sizeof(part), i));
+        }
+        add_iovec(address + (m_ranges[i].first - offset), m_ranges[i].last - m_ranges[i].first + 1);
+    }
+    if (m_range_cnt > 1)
+        add_response("\r\n--%s--\r\n", RANGE_BOUNDARY);
+}
+
+// 每段的格式是"长度\r\n正文\r\n"，长度固定写成4位十六进制(允许前导0)，先空出位置，正文直接生成到写缓冲区里
+// 一次最多生成CHUNK_BATCH字节，剩下的等这些发送完再由next_chunks()生成，大的响应也只占用几块写缓冲区
+void http_conn::add_chunks()
+{
+    static_assert(WRITE_BUFFER_SIZE <= 0xffff, "chunk size must fit in 4 hex digits");
+    static const char *hex = "0123456789abcdef";
+    static const int CHUNK_MIN_SPACE = 64 + 8;
+    int budget = CHUNK_BATCH;
+    while (budget > 0)
+    {
+        int space = 0;
+        char *buf = write_space(space);
+        // 当前块剩下的空间太小，跳到下一块
+        if (space < CHUNK_MIN_SPACE)
+        {
+            m_write_idx += space;
+            continue;
+        }
+        int n = m_chunk_source->read(buf + 6, space - 8);
+        if (n <= 0)
+        {
+            m_chunk_source.reset();
+            // 响应头已经发出，只能不发结尾的0长度块并关闭连接，浏览器据此知道响应不完整
+            if (n < 0)
+            {
+                LOG_ERROR("%s", "chunked response aborted");
+                m_keep_alive = false;
+                m_linger = false;
+                return;
+            }
+            add_response("%s", "0\r\n\r\n");
+            return;
+        }
+        for (int i = 0; i < 4; ++i)
+            buf[i] = hex[(n >> (12 - 4 * i)) & 0xf];
+        buf[4] = '\r';
+        buf[5] = '\n';
+        buf[n + 6] = '\r';
+        buf[n + 7] = '\n';
+        m_write_idx += n + 8;
+        add_iovec(buf, n + 8);
+        budget -= n;
+    }
+}
+
+// 上一段已经全部发送完毕，本批之前的响应也已经发完，写缓冲区从头开始写
+void http_conn::next_chunks()
+{
+    buffer_pool::get_instance()->put_all(m_write_chunks);
+    m_write_idx = 0;
+    m_iovec.clear();
+    m_iovec_idx = 0;
+    if (m_h2)
+    {
+        m_h2->release();
+        m_h2->produce();
+        return;
+    }
+    add_chunks();
+}
+
+// 根据process_read()的报文解析结果，向写缓冲区中写入响应报文
+// 内部涉及到add...系列函数，均是内部调用add_response函数，写入的同时追加到m_iovec
+// 流水线请求的响应依次追加在写缓冲区后面
 bool http_conn::process_write(HTTP_CODE ret)
 {
     switch (ret)
@@ -777,23 +1680,61 @@ bool http_conn::process_write(HTTP_CODE ret)
     // 文件请求,获取文件成功
     case FILE_REQUEST:
     {
+        // 范围请求:正文只有请求的范围，来自缓存、sendfile或者只映射了一部分的文件
+        if (m_range_cnt > 0)
+        {
+            add_status_line(206, partial_206_title);
+            add_range_headers();
+            if (1 == m_range_cnt)
+                add_content_type();
+            add_encoding();
+            add_validator();
+            add_accept_ranges();
+            add_linger();
+            add_blank_line();
+            if (m_cache_entry)
+                add_body(const_cast<char *>(m_cache_entry->body.data()), m_cache_entry->body.size(), 0);
+            else if (m_file_fd != -1)
+                m_bytes_to_send += m_ranges[0].last - m_ranges[0].first + 1;
+            else
+                add_body(m_file_address, m_file_map_len, m_file_map_offset);
+            return true;
+        }
+        // 命中缓存:状态行、Content-Length、校验字段和Accept-Ranges已经生成好，正文直接指向缓存的内容
+        if (m_cache_entry)
+        {
+            add_response("%s", m_cache_entry->headers.c_str());
+            add_content_type();
+            add_encoding();
+            add_cache_control();
+            add_linger();
+            add_blank_line();
+            add_body(const_cast<char *>(m_cache_entry->body.data()), m_cache_entry->body.size(), 0);
+            return true;
+        }
         // 添加状态行
         add_status_line(200, ok_200_title);
         // 如果请求的资源存在
         if (m_file_stat.st_size != 0)
         {
             // 添加应答头
-            add_headers(m_file_stat.st_size);
+            add_content_length(m_file_stat.st_size);
+            add_content_type();
+            add_encoding();
+            add_validator();
+            add_accept_ranges();
+            add_linger();
+            add_blank_line();
+            // sendfile方式只有响应头在写缓冲区里，正文由send_file()发送
+            if (m_file_fd != -1)
+            {
+                m_bytes_to_send += m_file_stat.st_size;
+                return true;
+            }
             // 使用多重写
-            // 第一个iovec指针指向m_write_buf写缓冲区
-            m_iovec[0].iov_base = m_write_buf;
-            m_iovec[0].iov_len = m_write_idx;
-            // 第二个iovec指针指向共享内存mmap返回的m_file_address
-            m_iovec[1].iov_base = m_file_address;
-            m_iovec[1].iov_len = m_file_stat.st_size;
-            m_iovec_cnt = 2;
+            // 响应头已经在写缓冲区的iovec里，再追加一个指向mmap返回的m_file_address
             // 待发送的全部数据为响应报文头部信息和文件大小
-            m_bytes_to_send = m_write_idx + m_file_stat.st_size;
+            add_body(m_file_address, m_file_map_len, m_file_map_offset);
             return true;
         }
         // 如果请求的资源大小为0，则返回空白html文件
@@ -803,40 +1744,213 @@ bool http_conn::process_write(HTTP_CODE ret)
             add_headers(strlen(ok_string));
             if (!add_content(ok_string))
                 return false;
+            return true;
         }
     }
+    // 条件请求的文件没有修改过，只返回校验字段，浏览器使用自己缓存的文件
+    case NOT_MODIFIED:
+    {
+        add_status_line(304, not_modified_304_title);
+        add_encoding();
+        add_validator();
+        add_linger();
+        if (!add_blank_line())
+            return false;
+        break;
+    }
+    // 生成的响应:没有Content-Length，先生成第一段正文，后面的发送时再生成
+    case CHUNKED_REQUEST:
+    {
+        add_status_line(200, ok_200_title);
+        add_content_type();
+        add_response("%s", "Transfer-Encoding:chunked\r\n");
+        add_linger();
+        if (!add_blank_line())
+            return false;
+        add_chunks();
+        return true;
+    }
+    // 范围都超出了文件，告诉浏览器文件的大小
+    case RANGE_NOT_SATISFIABLE:
+    {
+        add_status_line(416, error_416_title);
+        add_response("Content-Range:bytes */%lld\r\n", (long long)m_file_stat.st_size);
+        if (!add_headers(0))
+            return false;
+        break;
+    }
     default:
         return false;
     }
 
-    // 除FILE_REQUEST状态外，其余状态只申请一个iovec，指向响应报文缓冲区
-    m_iovec[0].iov_base = m_write_buf;
-    m_iovec[0].iov_len = m_write_idx;
-    m_iovec_cnt = 1;
-    m_bytes_to_send = m_write_idx;
+    // 除FILE_REQUEST状态外，其余状态的响应都在写缓冲区里
     return true;
 }
 
 // 数据读到了缓冲区之后，子线程会调用这个函数解析请求报文
+// 客户端可能流水线发送多个请求，缓冲区里完整的请求依次解析，响应追加到同一批里，最后一次writev发出
 void http_conn::process()
 {
-    // 报文解析
-    HTTP_CODE read_ret = process_read();
-
-    // 请求不完整，需要继续接收请求数据
-    if (read_ret == NO_REQUEST)
+    // 客户端直接以HTTP/2的连接前言开始(prior knowledge)，前言没收全时不能交给HTTP/1.1的解析
+    if (!m_h2)
     {
-        // 注册并监听读事件
-        m_utils.modfd(m_epollfd, m_sockfd, EPOLLIN, m_trigger_mode);
+        int preface = h2_preface();
+        if (0 == preface)
+        {
+            notify(EPOLLIN);
+            return;
+        }
+        if (1 == preface)
+            m_h2.reset(new h2_session(this));
+    }
+    if (m_h2)
+    {
+        process_h2();
         return;
     }
 
-    // 根据解析的报文状态，把需要发送的响应报文和文件添加到这个connfd的http的缓冲区，注意这缓冲区和socket的缓冲区不是一个东西
-    bool write_ret = process_write(read_ret);
-    if (!write_ret)
+    while (true)
     {
-        close_conn();
+        // 报文解析，数据库通道接着执行上次记下的路由
+        HTTP_CODE read_ret;
+        if (m_deferred)
+        {
+            const route *r = m_deferred;
+            m_deferred = nullptr;
+            read_ret = (this->*(r->handler))(r->file);
+        }
+        else
+        {
+            read_ret = process_read();
+        }
+
+        // 请求不完整，需要继续接收请求数据
+        if (read_ret == NO_REQUEST)
+            break;
+
+        // 交给数据库通道，本批已经生成的响应留在写缓冲区，由它接着处理，之后这里不能再访问连接
+        // 通道满了就在这里处理
+        if (read_ret == DEFERRED_REQUEST)
+        {
+            if (m_thread_pool->append_db(this))
+                return;
+            continue;
+        }
+
+        // h2c升级:101之后这个请求的响应和后面的请求都按HTTP/2处理
+        if (0 == m_resp_cnt && h2_upgrade() && upgrade_h2(read_ret))
+        {
+            next_request();
+            process_h2();
+            return;
+        }
+
+        // 根据解析的报文状态，把需要发送的响应报文和文件添加到这个connfd的http的缓冲区，注意这缓冲区和socket的缓冲区不是一个东西
+        bool write_ret = process_write(read_ret);
+        if (!write_ret)
+        {
+            close_conn();
+            notify(EPOLLOUT);
+            return;
+        }
+        m_linger = m_keep_alive;
+        ++m_resp_cnt;
+        next_request();
+
+        // 短连接、sendfile发送的大文件、还没生成完的分块响应或一批已满时，剩下的请求等这一批发完再解析
+        if (!m_linger || m_file_fd != -1 || m_chunk_source || m_resp_cnt >= MAX_PIPELINE)
+            break;
+    }
+    compact_read_buf();
+
+    // 一个完整的请求都没有，注册并监听读事件
+    if (0 == m_resp_cnt)
+    {
+        notify(EPOLLIN);
+        return;
     }
     // 注册并监听写事件，之后就会被epoll检测
-    m_utils.modfd(m_epollfd, m_sockfd, EPOLLOUT, m_trigger_mode);
+    notify(EPOLLOUT);
+}
+
+// 只在一批的开头检查，流水线请求后面的前言按HTTP/1.1解析，返回400
+int http_conn::h2_preface()
+{
+    if (m_resp_cnt != 0 || m_check_state != CHECK_STATE_REQUESTLINE || m_checked_idx != m_request_start)
+        return -1;
+    int avail = m_read_idx - m_checked_idx;
+    if (0 == avail)
+        return -1;
+    for (int i = 0; i < avail && i < h2_session::PREFACE_LEN; ++i)
+    {
+        if (read_byte(m_checked_idx + i) != h2_session::PREFACE[i])
+            return -1;
+    }
+    return avail >= h2_session::PREFACE_LEN ? 1 : 0;
+}
+
+// 只升级没有请求体的GET，升级请求的Connection字段是Upgrade, HTTP2-Settings
+bool http_conn::h2_upgrade() const
+{
+    return m_upgrade && m_http2_settings && GET == m_method && strcasecmp(m_upgrade, "h2c") == 0;
+}
+
+bool http_conn::upgrade_h2(HTTP_CODE ret)
+{
+    std::unique_ptr<h2_session> h2(new h2_session(this));
+    if (!h2->upgrade(m_http2_settings))
+        return false;
+    add_response("%s", "HTTP/1.1 101 Switching Protocols\r\nConnection:Upgrade\r\nUpgrade:h2c\r\n\r\n");
+    m_h2 = std::move(h2);
+    m_h2->upgrade_response(ret);
+    return true;
+}
+
+// 解析完整的帧，控制帧和响应头写到写缓冲区，再按发送窗口生成DATA帧
+// 读缓冲区里不完整的帧留到下次；连接出错时写入GOAWAY，发送完毕后关闭
+void http_conn::process_h2()
+{
+    m_linger = m_h2->process();
+    m_request_start = m_checked_idx;
+    m_start_line = m_checked_idx;
+    compact_read_buf();
+    if (m_linger)
+        m_h2->produce();
+
+    // 没有要发送的帧，比如窗口用完了或者请求还没收全，等待对方的数据
+    if (0 == m_bytes_to_send)
+    {
+        notify(EPOLLIN);
+        return;
+    }
+    notify(EPOLLOUT);
+}
+
+const char *http_conn::error_page(HTTP_CODE ret, int &status)
+{
+    switch (ret)
+    {
+    case FORBIDDEN_REQUEST:
+        status = 403;
+        return error_403_form;
+    case BAD_REQUEST:
+    case NO_RESOURCE:
+        status = 404;
+        return error_404_form;
+    default:
+        status = 500;
+        return error_500_form;
+    }
+}
+
+// Proactor模式直接重置oneshot事件
+// Reactor模式把连接交回事件循环，由它重置oneshot事件或关闭连接；io_uring模式由它提交recv或writev
+void http_conn::notify(int ev)
+{
+    if (m_completions)
+    {
+        m_completions->push(this, ev);
+        return;
+    }
+    m_utils.modfd(m_epollfd, m_sockfd, ev, m_trigger_mode);
 }
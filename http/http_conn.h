@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <cassert>
 #include <sys/stat.h>
@@ -19,18 +20,39 @@
 #include <cerrno>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <climits>
+#include <sys/sendfile.h>
 #include <map>
 #include <mysql/mysql.h>
 #include <fstream>
 #include <string>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <list>
 
 #include "../lock/locker.hpp"
 #include "../connpool/conn_pool.h"
 #include "../timer/timer.h"
+#include "../cache/file_cache.h"
+#include "../cache/compressor.h"
+#include "../buffer/buffer_pool.h"
+#include "http_scanner.h"
+#include "header_table.hpp"
+#include "mime_types.hpp"
+#include "dir_listing.h"
+#include "h2_session.h"
+#include "router.hpp"
 #include "../log/log.h"
+#include "../reactor/completion_queue.hpp"
+
+template <typename T>
+class threadpool;
 
 class http_conn
 {
+    friend class h2_session; // HTTP/2的请求同样由do_request处理，响应帧写到写缓冲区
+
 public:
     /* 1. HTTP请求方法，支持GET和POST */
     enum METHOD
@@ -64,6 +86,9 @@ public:
         NO_RESOURCE         服务器没有资源
         FORBIDDEN_REQUEST   客户对资源没有足够的访问权限
         FILE_REQUEST        文件请求,获取文件成功
+        NOT_MODIFIED        条件请求,文件没有修改过，返回不带正文的304
+        RANGE_NOT_SATISFIABLE 范围请求的范围都超出了文件，返回416
+        CHUNKED_REQUEST     生成的响应，长度事先不知道，正文由m_chunk_source分块发送
         INTERNAL_ERROR      服务器内部错误
         CLOSED_CONNECTION   客户端已经关闭连接*/
     enum HTTP_CODE
@@ -74,6 +99,10 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        NOT_MODIFIED,
+        RANGE_NOT_SATISFIABLE,
+        CHUNKED_REQUEST,
+        DEFERRED_REQUEST, // 交给线程池的数据库通道处理，由process()在本次处理的最后交出去
         INTERNAL_ERROR,
         CLOSED_CONNECTION
     };
@@ -89,13 +118,38 @@ public:
         LINE_OPEN
     };
 
+    // 一批响应中某个响应的文件正文，整批发送完毕后统一释放
+    struct response_body
+    {
+        char *address;                                 // mmap映射的地址或缓存的文件内容
+        size_t size;                                   // 正文长度
+        std::shared_ptr<const file_entry> cache_entry; // 命中缓存时持有缓存项，为空表示是mmap映射的
+    };
+
+    // Range请求的一个范围，first和last都包含在内
+    struct byte_range
+    {
+        off_t first;
+        off_t last;
+    };
+
+    // 路由的处理函数，file是注册时给定的参数，一般是要返回的页面，为空表示按请求的路径
+    // blocking表示处理POST时会阻塞在数据库上，有数据库通道时交给它处理
+    typedef HTTP_CODE (http_conn::*route_handler)(const char *file);
+    struct route
+    {
+        route_handler handler;
+        const char *file;
+        bool blocking;
+    };
+
 public:
-    http_conn(){};
+    http_conn() : m_file_address(nullptr), m_file_fd(-1), m_body_cnt(0){};
     ~http_conn(){};
 
     // 初始化套接字，会调用私有函数void init()
-    void init(int sockfd, const sockaddr_in &address, char *root, int trigger_mode, int close_log,
-              const string &user, const string &passwd, const string &sql_name);
+    void init(int sockfd, const sockaddr_in &address, int epollfd, completion_queue<http_conn> *completions,
+              char *root, int trigger_mode, int close_log, const string &user, const string &passwd, const string &sql_name);
 
     // 关闭HTTP连接
     void close_conn(bool real_close = true);
@@ -106,89 +160,197 @@ public:
     // 把数据从socket缓冲读到http缓冲
     bool read();
 
+    // 把已经收到的数据追加到读缓冲区，io_uring模式使用，超过请求大小上限返回false
+    bool append(const char *data, int len);
+
     // 把数据从http缓冲读到socket缓冲
     bool write();
 
     sockaddr_in *get_address() { return &m_address; };
 
+    // 上一批响应已经发送完毕，读缓冲区里还有没解析的流水线请求
+    // 这时write()没有重新注册事件，由调用者交给工作线程接着process()
+    bool has_request() const { return 0 == m_bytes_to_send && m_checked_idx < m_read_idx; }
+
+    // 当前这一批发送完毕后还会接着生成下一批:分块响应没有生成完，或者HTTP/2还有窗口允许发送的正文
+    bool more_to_send() const { return m_chunk_source || (m_h2 && m_h2->want_write()); }
+
+    // 错误响应的状态码和正文
+    static const char *error_page(HTTP_CODE ret, int &status);
+
+    // 注册一个路由，prefix为true时匹配以path开头的所有路径，精确匹配优先，其次最长的前缀
+    // blocking为true时POST请求交给线程池的数据库通道，不占用处理静态文件的线程
+    // 在服务器启动之前调用，之后路由表只读
+    static void add_route(const char *path, route_handler handler, const char *file = nullptr, bool prefix = false,
+                          bool blocking = false);
+
     // 初始化读取账户和密码
     void init_mysql_result(connection_pool *connPool);
 
+    /*** io_uring模式下由事件循环调用，收发由io_uring完成 ***/
+    off_t advance_send(int bytes); // 已发送bytes字节，更新iovec，返回剩余待发送字节数，分块响应发完一段时接着生成下一段
+    struct iovec *send_iovec(int &cnt); // 还没发送的iovec，cnt为个数，一次最多IOV_MAX个
+    bool finish_send();          // 响应发送完毕，长连接返回true并重置连接状态
+    void unmap();                // 取消内存映射，sendfile方式则关闭文件，命中缓存则释放缓存项
+
 private:
     // 由public的init调用，对私有成员进程初始化
     void init();
+    void init_write();       // 一批响应发送完毕，重置写缓冲区
+    void next_request();     // 一个请求处理完毕，重置解析状态，接着解析读缓冲区里的下一个请求
+    void compact_read_buf(); // 处理完的块还回内存池
 
     /*** 从读缓冲区读取报文并解析报文 ***/
-    HTTP_CODE process_read();                               // 从m_read_buf读取，并解析报文入口
-    HTTP_CODE parse_request_line(char *text);               // 解析HTTP请求行:获得请求方法，目标URL,以及HTTP版本号
-    HTTP_CODE parse_headers(char *text);                    // 解析HTTP请求的一个头部信息
-    HTTP_CODE parse_content(char *text);                    // 解析HTTP请求的消息体
-    LINE_STATUS parse_line();                               // 从状态机读取一行，分析是请求报文的哪一部分
-    char *get_line() { return m_read_buf + m_start_line; }; // 拿到从状态机已经解析好的一行,m_start_line是从状态机已经解析的字符
-    HTTP_CODE do_request();                                 // 根据解析的请求，将不同的相应页面准备好
+    HTTP_CODE process_read();                 // 从读缓冲区读取，并解析报文入口
+    HTTP_CODE parse_request_line(char *text); // 解析HTTP请求行:获得请求方法，目标URL,以及HTTP版本号
+    HTTP_CODE parse_headers(char *text);      // 解析HTTP请求的一个头部信息
+    HTTP_CODE set_request_line(char *method); // 请求行已经分成三个字段，检查方法和版本，整理m_url
+    HTTP_CODE parse_header(std::string_view name, char *value); // 按字段名处理一个请求头
+    bool scan_request(HTTP_CODE &ret);        // 请求头在同一块里时一次扫描完，返回false时交给按行解析的状态机
+    HTTP_CODE parse_content();                // 解析HTTP请求的消息体
+    LINE_STATUS parse_line();                 // 从状态机读取一行，分析是请求报文的哪一部分
+    char *get_line();                         // 拿到从状态机已经解析好的一行,m_start_line是从状态机已经解析的字符
+    char *get_content();                      // 拿到以\0结尾的消息体，只有登录和注册用到
+    HTTP_CODE do_request();                   // 根据解析的请求，按路由表交给对应的处理函数
+    static router<route> &routes();           // 路由表
+
+    /*** 路由的处理函数，返回值和do_request相同 ***/
+    HTTP_CODE do_file(const char *url);       // 静态文件，把文件路径准备好
+    bool select_encoding();                   // 可压缩的文件选择压缩版本，返回true表示用的是文件缓存记住的结果
+    HTTP_CODE do_login(const char *);         // 登录校验
+    HTTP_CODE do_register(const char *);      // 注册校验
+    HTTP_CODE do_metrics(const char *);       // 运行统计
+    bool not_modified();                      // 条件请求的文件没有修改过
+    HTTP_CODE parse_range();                  // 解析Range，结果在m_ranges
+
+    /*** HTTP/2 ***/
+    int h2_preface();                    // 读缓冲区从当前请求开始是否为HTTP/2连接前言:1是，0还没收全，-1不是
+    bool h2_upgrade() const;             // 当前请求要求升级到h2c
+    bool upgrade_h2(HTTP_CODE ret);      // 发送101并创建h2_session，ret作为流1的响应，HTTP2-Settings不对时返回false
+    void process_h2();                   // HTTP/2连接的process()
+
+    /*** 读缓冲区由buffer_pool的若干块组成，下标是从第一块开头算起的逻辑位置 ***/
+    char &read_byte(int idx) { return m_read_chunks[idx / READ_BUFFER_SIZE][idx % READ_BUFFER_SIZE]; }
+    char *read_space(int &len); // 返回可以写入新数据的位置和长度，最后一块满了就再取一块
+    void free_read_buf();       // 所有块还回内存池
 
     /*** 根据解析返回的HTTP_CODE向写缓冲区写入数据 ***/
-    bool process_write(HTTP_CODE ret); // 向m_write_buf写入响应报文数据，入口
+    bool process_write(HTTP_CODE ret); // 向写缓冲区写入响应报文数据，入口
     // 根据响应报文格式，生成对应8个部分，以下函数均由do_request调用
     bool add_response(const char *format, ...);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
     bool add_headers(int content_length);
     bool add_content_type();
-    bool add_content_length(int content_length);
+    bool add_encoding(); // Content-Encoding和Vary
+    bool add_content_length(off_t content_length);
     bool add_linger();
     bool add_blank_line();
-    void unmap();
+    bool add_validator(); // ETag、Last-Modified和Cache-Control
+    bool add_cache_control();
+    bool add_accept_ranges();
+    bool add_range_headers(); // 206响应的Content-Range或multipart类型，以及Content-Length
+    int range_part_header(char *buf, int len, int i); // 多段范围请求第i段的分段头
+    void add_iovec(char *base, size_t len);    // 把一段待发送的数据追加到m_iovec，和上一段相邻时合并
+    char *write_space(int &len);               // 写缓冲区中可以继续写入的位置和长度
+    void add_text(const char *data, int len);  // 把数据拷贝到写缓冲区，当前块放不下时分段写到后面的块
+    void add_body(char *address, size_t size, off_t offset); // 追加当前请求的文件正文，offset为address在文件中的位置，发送完毕后由unmap()释放
+    void add_chunks();  // 从m_chunk_source取最多CHUNK_BATCH字节，按chunked格式写到写缓冲区，正文结束时追加结尾的0长度块
+    void next_chunks(); // 写缓冲区已经全部发送，块还回池里，接着生成下一段或HTTP/2的下一批DATA帧
 
 public:
+    // sendfile方式发送一次:先用MSG_MORE发送响应头，头部发完后由内核直接把文件发送到socket
+    int send_file();
+
+    // 本次处理结束，通知事件循环接下来等待ev事件，ev为0表示关闭连接
+    // 有完成队列时交回事件循环处理，否则直接重置oneshot事件
+    void notify(int ev);
+
     // static变量类内声明，类外初始化
-    static int m_epollfd;    // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
-    static int m_user_count; // 统计用户的数量
+    static std::atomic<int> m_user_count; // 统计用户的数量，多个reactor线程会同时修改
     // static const在声明时需要指定值
     static const int FILENAME_LEN = 200;       // 读取文件长度上限
-    static const int READ_BUFFER_SIZE = 2048;  // 读缓存大小
-    static const int WRITE_BUFFER_SIZE = 1024; // 写缓存大小
+    static const int READ_BUFFER_SIZE = buffer_pool::CHUNK_SIZE; // 读缓冲区每一块的大小
+    static const int MAX_HEADER_SIZE = 64 * 1024;                // 请求行和请求头的大小上限
+    static const int MAX_CONTENT_LENGTH = 8 * 1024 * 1024;       // 请求体的大小上限
+    static const int WRITE_BUFFER_SIZE = buffer_pool::CHUNK_SIZE; // 写缓冲区每一块的大小
+    static const int SENDFILE_MIN_SIZE = 16 * 1024; // 不小于该大小的文件才用sendfile发送，小文件仍然mmap
+    static const int MAX_PIPELINE = 16;             // 流水线请求一批最多合并发送的响应数
+    static const int MAX_RANGES = 16;               // 一个Range请求最多的范围数，超过时忽略Range
+    static constexpr const char *RANGE_BOUNDARY = "toy_web_server_byteranges"; // 多段范围响应的分隔符
+    static const int CHUNK_BATCH = 8 * WRITE_BUFFER_SIZE; // 分块响应每次生成的正文上限，发送完再生成，占用的写缓冲区有上限
 
-    // 这两个参数是reactor模式中用到了
-    int timer_flag;
-    int improv;
+    static int m_send_mode; // 静态文件发送方式:0为mmap+writev，1为大文件sendfile，所有连接共用
+    static char m_cache_control[32]; // 静态文件响应的Cache-Control字段值，为空时不发送
+    static int m_autoindex;          // 请求目录时是否返回文件列表，为0时返回404
+    static threadpool<http_conn> *m_thread_pool; // 处理请求的线程池，/metrics统计和交给数据库通道用
 
-    MYSQL *m_mysql; // 从连接池中取出一个mysql连接
     int m_io_state; // IO事件类别:读为0, 写为1
+    int64_t m_queued_at; // 放进线程池队列的时间(纳秒)，线程池统计排队时间
 
+    int m_epollfd;         // 该连接注册到的epoll，多reactor时每个从reactor各有一个，io_uring模式为-1
+    completion_queue<http_conn> *m_completions; // Reactor和io_uring模式下处理结果交回事件循环的队列，否则为空
     int m_sockfd;          // 该HTTP连接的socket
     sockaddr_in m_address; // 对方的socket地址
 
     /*** 读缓冲区 ***/
-    char m_read_buf[READ_BUFFER_SIZE]; // 存储读取的请求报文数据
-    int m_read_idx;                    // m_read_buf中数据的最后一个字节的下一个位置
-    int m_checked_idx;                 // m_read_buf读取的位置
-    int m_start_line;                  // m_read_buf中已经解析的字符个数
+    std::vector<char *> m_read_chunks; // 存储读取的请求报文数据，从buffer_pool取的块依次拼接，块的位置不会移动
+    int m_read_idx;                    // 读缓冲区中数据的最后一个字节的下一个位置
+    int m_checked_idx;                 // 读缓冲区读取的位置
+    int m_start_line;                  // 读缓冲区中已经解析的字符个数
+    int m_request_start;               // 当前请求在读缓冲区中的起点，之前的流水线请求都已处理完
+    std::list<std::string> m_lines;    // 跨块的行拷贝到这里，解析出的指针在请求处理完之前一直有效
+    std::string m_content_buf;         // 拼接好的消息体
 
     /*** 写缓冲区 ***/
-    char m_write_buf[WRITE_BUFFER_SIZE]; // HTTP的写缓冲区，和socket的缓冲区不同
-    int m_write_idx;                     // 指示buffer中的长度
-    int m_bytes_to_send;                 // 剩余发送字节数
-    int m_bytes_have_send;               // 已发送字节数
+    std::vector<char *> m_write_chunks; // HTTP的写缓冲区，和socket的缓冲区不同，从buffer_pool取的块依次拼接
+    int m_write_idx;                    // 写缓冲区中已经写入的长度
+    off_t m_bytes_to_send;               // 剩余发送字节数，大于2G的文件也不能溢出
+    off_t m_bytes_have_send;             // 已发送字节数
+    int m_resp_cnt;                      // 本批已经生成的响应数，流水线请求的响应依次追加到写缓冲区
+    bool m_linger;                       // 本批最后一个响应是否长连接，决定发送完毕后是否保持连接
 
     /*** 解析HTTP报文并保存相关的参数 ***/
     CHECK_STATE m_check_state; // 主状态机的状态
     METHOD m_method;           // 请求方法，get还是post
     char *m_file_address;      // 文件地址
+    int m_file_fd;             // sendfile方式下打开的文件，mmap方式为-1
+    std::shared_ptr<const file_entry> m_cache_entry; // 命中缓存时正文指向缓存的文件内容，发送期间持有
+    off_t m_file_offset;       // sendfile方式下文件的发送位置
+    off_t m_file_map_offset;   // mmap映射的起点在文件中的位置，范围请求只映射需要的部分
+    size_t m_file_map_len;     // mmap映射的长度
     struct stat m_file_stat;   // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iovec[2];   // 我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量。
-    int m_iovec_cnt;
+    std::vector<struct iovec> m_iovec;      // 我们将采用writev来执行写操作，依次指向写缓冲区里的响应头和各个文件正文
+    int m_iovec_idx;                        // 第一个还没发送完的iovec
+    response_body m_bodies[MAX_PIPELINE];   // 本批响应的文件正文
+    int m_body_cnt;
+    std::unique_ptr<chunk_source> m_chunk_source; // 分块响应还没有生成的正文，为空表示没有正在发送的分块响应
+    std::unique_ptr<h2_session> m_h2;             // 升级到HTTP/2之后的连接状态，为空表示HTTP/1.1
 
     char m_real_file[FILENAME_LEN]; // 客户请求的目标文件的完整路径，其内容等于 m_doc_root + m_url
     char *m_url;                    // 客户请求的目标文件的文件名
     char *m_version;                // HTTP协议版本号，我们仅支持HTTP1.1
     char *m_host;                   // 主机名
+    char *m_if_none_match;          // 条件请求:浏览器缓存的ETag
+    char *m_if_modified_since;      // 条件请求:浏览器缓存的Last-Modified
+    file_validator m_validator;     // 目标文件的ETag和Last-Modified
+    char *m_range;                  // 范围请求:Range字段
+    char *m_if_range;               // 范围请求:文件和If-Range一致时Range才生效
+    byte_range m_ranges[MAX_RANGES]; // 解析出的范围
+    int m_range_cnt;                // 范围数，0表示返回整个文件
+    int m_accept_encoding;          // 浏览器接受的压缩编码，CONTENT_ENCODING按位或
+    char *m_upgrade;                // Upgrade字段，h2c表示要求升级到明文HTTP/2
+    char *m_http2_settings;         // h2c升级请求带的SETTINGS
+    const char *m_content_type;     // 按原文件扩展名查到的Content-Type
+    int m_content_encoding;         // 发送的是哪种压缩版本，ENCODING_IDENTITY为原文件
+    bool m_vary;                    // 可压缩的文件，响应要带Vary:Accept-Encoding
     int m_content_length;           // HTTP请求的消息总长度
     bool m_keep_alive;              // HTTP请求是否要求保持连接
     char *m_doc_root;               // 资源目录
 
     int m_cgi;       // 是否启用的POST
     char *m_content; // HTTP请求的请求体内容
+    const route *m_deferred; // 交给数据库通道、还没有执行的路由，为空表示没有
 
     int m_trigger_mode;
     int m_close_log;
@@ -196,8 +358,6 @@ public:
     char m_sql_user[100];
     char m_sql_passwd[100];
     char m_sql_name[100];
-
-    locker m_http_lock;
 };
 
 #endif
@@ -0,0 +1,196 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANNER_X86
+#endif
+
+#include "http_scanner.h"
+
+typedef const char *(*find_eol_fn)(const char *p, const char *end);
+
+// 逐字节找\r或\n，也用来处理SIMD版本剩下的不足一个向量的尾部
+static const char *find_eol_scalar(const char *p, const char *end)
+{
+    for (; p < end; ++p)
+    {
+        if (*p == '\r' || *p == '\n')
+            return p;
+    }
+    return end;
+}
+
+#ifdef SCANNER_X86
+// 每次比较16字节，pcmpestri直接给出第一个\r或\n的下标
+__attribute__((target("sse4.2"))) static const char *find_eol_sse42(const char *p, const char *end)
+{
+    const __m128i eol = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(eol, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16)
+            return p + idx;
+    }
+    return find_eol_scalar(p, end);
+}
+
+// 每次比较32字节，两次比较的结果合并成位掩码，最低的1就是第一个\r或\n
+__attribute__((target("avx2"))) static const char *find_eol_avx2(const char *p, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return find_eol_sse42(p, end);
+}
+#endif
+
+static bool isa_supported(http_scanner::ISA isa)
+{
+#ifdef SCANNER_X86
+    __builtin_cpu_init();
+    if (http_scanner::AVX2 == isa)
+        return __builtin_cpu_supports("avx2");
+    if (http_scanner::SSE42 == isa)
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    return http_scanner::SCALAR == isa;
+}
+
+static find_eol_fn isa_impl(http_scanner::ISA isa)
+{
+#ifdef SCANNER_X86
+    if (http_scanner::AVX2 == isa)
+        return find_eol_avx2;
+    if (http_scanner::SSE42 == isa)
+        return find_eol_sse42;
+#endif
+    return find_eol_scalar;
+}
+
+static http_scanner::ISA best_isa()
+{
+    if (isa_supported(http_scanner::AVX2))
+        return http_scanner::AVX2;
+    if (isa_supported(http_scanner::SSE42))
+        return http_scanner::SSE42;
+    return http_scanner::SCALAR;
+}
+
+static http_scanner::ISA g_isa = best_isa();
+static find_eol_fn g_find_eol = isa_impl(g_isa);
+
+http_scanner::ISA http_scanner::isa()
+{
+    return g_isa;
+}
+
+bool http_scanner::set_isa(ISA isa)
+{
+    if (!isa_supported(isa))
+        return false;
+    g_isa = isa;
+    g_find_eol = isa_impl(isa);
+    return true;
+}
+
+const char *http_scanner::isa_name(ISA isa)
+{
+    switch (isa)
+    {
+    case AVX2:
+        return "avx2";
+    case SSE42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+static const char *skip_blank(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+static const char *find_blank(const char *p, const char *end)
+{
+    while (p < end && *p != ' ' && *p != '\t')
+        ++p;
+    return p;
+}
+
+// 找到[p, end)中第一行的\r，行尾必须是\r\n
+// 返回PARSE_PARTIAL表示还没收到行尾，PARSE_ERROR表示单独的\r或\n
+static int find_line(const char *p, const char *end, find_eol_fn find_eol, const char *&eol)
+{
+    eol = find_eol(p, end);
+    if (eol == end)
+        return http_scanner::PARSE_PARTIAL;
+    if (*eol != '\r')
+        return http_scanner::PARSE_ERROR;
+    if (eol + 1 == end)
+        return http_scanner::PARSE_PARTIAL;
+    if (eol[1] != '\n')
+        return http_scanner::PARSE_ERROR;
+    return 0;
+}
+
+int http_scanner::parse_request(const char *buf, int len, http_request_head &head)
+{
+    find_eol_fn find_eol = g_find_eol;
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *eol = nullptr;
+
+    // 请求行:方法、目标和版本之间可以有多个空格或\t，和按行解析的状态机一致
+    int ret = find_line(p, end, find_eol, eol);
+    if (ret < 0)
+        return ret;
+    const char *sep = find_blank(p, eol);
+    if (sep == p || sep == eol)
+        return PARSE_ERROR;
+    head.method = std::string_view(p, sep - p);
+    p = skip_blank(sep, eol);
+    sep = find_blank(p, eol);
+    if (sep == p || sep == eol)
+        return PARSE_ERROR;
+    head.target = std::string_view(p, sep - p);
+    p = skip_blank(sep, eol);
+    head.version = std::string_view(p, eol - p);
+    p = eol + 2;
+
+    // 请求头，空行结束
+    head.header_cnt = 0;
+    while (true)
+    {
+        if (p == end)
+            return PARSE_PARTIAL;
+        if (*p == '\r')
+        {
+            if (p + 1 == end)
+                return PARSE_PARTIAL;
+            if (p[1] != '\n')
+                return PARSE_ERROR;
+            return p + 2 - buf;
+        }
+        ret = find_line(p, end, find_eol, eol);
+        if (ret < 0)
+            return ret;
+        const char *colon = (const char *)memchr(p, ':', eol - p);
+        if (!colon || head.header_cnt == http_request_head::MAX_HEADERS)
+            return PARSE_ERROR;
+        const char *value = skip_blank(colon + 1, eol);
+        http_header &header = head.headers[head.header_cnt++];
+        header.name = std::string_view(p, colon - p);
+        header.value = std::string_view(value, eol - value);
+        p = eol + 2;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+#include <string_view>
+
+// 一个请求头，name和value都指向读缓冲区，不拷贝
+// value跳过了冒号后面的空格和\t，到\r为止
+struct http_header
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// 扫描出的请求行和全部请求头
+struct http_request_head
+{
+    static const int MAX_HEADERS = 64; // 超过这个数量交给按行解析的状态机
+
+    std::string_view method;
+    std::string_view target;
+    std::string_view version;
+    http_header headers[MAX_HEADERS];
+    int header_cnt;
+};
+
+// 请求头扫描器，参考picohttpparser
+// 在一段连续的缓冲区里一次找出请求行的三个字段和全部请求头，结果都是指向缓冲区的string_view
+// 查找行尾\r\n用SIMD指令，启动时按CPU支持的指令集选择AVX2、SSE4.2或逐字节的实现
+class http_scanner
+{
+public:
+    enum ISA
+    {
+        SCALAR = 0,
+        SSE42,
+        AVX2
+    };
+
+    // parse_request的返回值，大于0时为请求行、请求头和空行的总长度
+    static const int PARSE_ERROR = -1;   // 格式错误
+    static const int PARSE_PARTIAL = -2; // 请求头还不完整
+
+    static int parse_request(const char *buf, int len, http_request_head &head);
+
+    static ISA isa();                   // 当前使用的指令集
+    static bool set_isa(ISA isa);       // 切换指令集，CPU不支持时返回false，微基准测试用
+    static const char *isa_name(ISA isa);
+};
+
+#endif
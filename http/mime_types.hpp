@@ -0,0 +1,72 @@
+#ifndef MIME_TYPES_HPP
+#define MIME_TYPES_HPP
+
+#include <strings.h>
+#include <cstring>
+
+// 文件扩展名对应的Content-Type，compressible表示值得压缩(文本类)
+struct mime_type
+{
+    const char *ext;
+    const char *type;
+    bool compressible;
+};
+
+inline constexpr mime_type MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8", true},
+    {"htm", "text/html; charset=utf-8", true},
+    {"css", "text/css; charset=utf-8", true},
+    {"js", "application/javascript; charset=utf-8", true},
+    {"mjs", "application/javascript; charset=utf-8", true},
+    {"json", "application/json", true},
+    {"xml", "application/xml", true},
+    {"txt", "text/plain; charset=utf-8", true},
+    {"csv", "text/csv; charset=utf-8", true},
+    {"md", "text/markdown; charset=utf-8", true},
+    {"svg", "image/svg+xml", true},
+    {"ico", "image/x-icon", true},
+    {"wasm", "application/wasm", true},
+    {"jpg", "image/jpeg", false},
+    {"jpeg", "image/jpeg", false},
+    {"png", "image/png", false},
+    {"gif", "image/gif", false},
+    {"webp", "image/webp", false},
+    {"avif", "image/avif", false},
+    {"bmp", "image/bmp", false},
+    {"mp4", "video/mp4", false},
+    {"webm", "video/webm", false},
+    {"ogv", "video/ogg", false},
+    {"mov", "video/quicktime", false},
+    {"mp3", "audio/mpeg", false},
+    {"ogg", "audio/ogg", false},
+    {"wav", "audio/wav", false},
+    {"flac", "audio/flac", false},
+    {"woff", "font/woff", false},
+    {"woff2", "font/woff2", false},
+    {"ttf", "font/ttf", false},
+    {"otf", "font/otf", false},
+    {"pdf", "application/pdf", false},
+    {"zip", "application/zip", false},
+    {"gz", "application/gzip", false},
+    {"br", "application/x-brotli", false},
+    {"tar", "application/x-tar", false},
+};
+
+inline constexpr mime_type MIME_DEFAULT = {"", "application/octet-stream", false};
+
+// 按最后一个'.'之后的扩展名查表，不区分大小写，没有扩展名或者不认识时返回application/octet-stream
+inline const mime_type &find_mime(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    if (!dot || (slash && dot < slash))
+        return MIME_DEFAULT;
+    for (const mime_type &mime : MIME_TYPES)
+    {
+        if (strcasecmp(dot + 1, mime.ext) == 0)
+            return mime;
+    }
+    return MIME_DEFAULT;
+}
+
+#endif
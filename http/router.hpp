@@ -0,0 +1,80 @@
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+#include <string_view>
+#include <vector>
+
+// 按请求路径查找处理函数，支持精确匹配和前缀匹配
+// 路径存成字典树，节点放在一个vector里，子节点用下标串成链表，查找只按字符走一遍，不分配内存
+// 启动时注册好所有路由，之后只读，多个工作线程同时查找不需要加锁
+template <typename T>
+class router
+{
+public:
+    router() : m_nodes(1, node{0, -1, -1, -1, -1}) {}
+
+    // 注册一个路由，prefix为true时匹配以path开头的所有路径，同一路径重复注册时覆盖
+    void add(std::string_view path, const T &value, bool prefix = false)
+    {
+        int n = 0;
+        for (char ch : path)
+        {
+            int c = m_nodes[n].child;
+            while (c >= 0 && m_nodes[c].ch != ch)
+                c = m_nodes[c].sibling;
+            if (c < 0)
+            {
+                c = m_nodes.size();
+                m_nodes.push_back(node{ch, -1, m_nodes[n].child, -1, -1});
+                m_nodes[n].child = c;
+            }
+            n = c;
+        }
+        int &slot = prefix ? m_nodes[n].prefix : m_nodes[n].exact;
+        if (slot < 0)
+        {
+            slot = m_values.size();
+            m_values.push_back(value);
+        }
+        else
+        {
+            m_values[slot] = value;
+        }
+    }
+
+    // 精确匹配优先，否则取最长的前缀匹配，都没有时返回空；path中?之后的查询串不参与匹配
+    const T *find(std::string_view path) const
+    {
+        path = path.substr(0, path.find('?'));
+        const T *best = nullptr;
+        int n = 0;
+        for (size_t i = 0;; ++i)
+        {
+            if (m_nodes[n].prefix >= 0)
+                best = &m_values[m_nodes[n].prefix];
+            if (i == path.size())
+                return m_nodes[n].exact >= 0 ? &m_values[m_nodes[n].exact] : best;
+            int c = m_nodes[n].child;
+            while (c >= 0 && m_nodes[c].ch != path[i])
+                c = m_nodes[c].sibling;
+            if (c < 0)
+                return best;
+            n = c;
+        }
+    }
+
+private:
+    struct node
+    {
+        char ch;     // 从父节点到这里的字符
+        int child;   // 第一个子节点
+        int sibling; // 下一个兄弟节点
+        int exact;   // 路径正好到这里时的处理函数在m_values中的下标，-1表示没有
+        int prefix;  // 以这里为前缀的处理函数
+    };
+
+    std::vector<node> m_nodes; // m_nodes[0]是根，对应空路径
+    std::vector<T> m_values;
+};
+
+#endif
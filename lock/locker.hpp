@@ -4,6 +4,13 @@
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <ctime>
+#include <cerrno>
+#include <atomic>
+#include <cstdint>
 
 // 二值信号量类
 class sem
@@ -129,4 +136,39 @@ private:
     pthread_cond_t m_cond;
 };
 
+// futex等待字，用于线程的休眠和唤醒
+// 等待方先load()出当前值，确认确实没事可做之后再wait()，这期间值被改过就立即返回，不会错过唤醒
+// 唤醒方改值再唤醒，是否有线程在等由调用者自己记录，没有时不需要系统调用
+class futex
+{
+public:
+    futex() : m_word(0) {}
+
+    uint32_t load() const
+    {
+        return m_word.load(std::memory_order_acquire);
+    }
+
+    // 值仍等于expected时休眠，直到被唤醒或者timeout_ms毫秒后返回，timeout_ms小于0时不超时
+    // 返回false表示超时
+    bool wait(uint32_t expected, int timeout_ms = -1)
+    {
+        struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+        long ret = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_word), FUTEX_WAIT_PRIVATE, expected,
+                           timeout_ms < 0 ? nullptr : &ts, nullptr, 0);
+        return !(ret < 0 && ETIMEDOUT == errno);
+    }
+
+    // 改变值，唤醒最多n个等待的线程
+    void wake(int n)
+    {
+        m_word.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&m_word), FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+    }
+
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex需要32位的等待字");
+    std::atomic<uint32_t> m_word;
+};
+
 #endif
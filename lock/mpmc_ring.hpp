@@ -0,0 +1,161 @@
+#ifndef MPMC_RING_HPP
+#define MPMC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// 有界无锁环形队列，多生产者多消费者(Dmitry Vyukov的算法)
+// 每一格带一个序号:序号等于下标时可以写，等于下标+1时可以读，读完改成下标+容量留给下一轮
+// push和pop各自用CAS抢下标，抢到之后只操作自己那一格，互相不需要锁
+// 生产者和消费者的下标分在不同的缓存行，元素按值存放，push和pop都是移动，不拷贝
+// 不阻塞，满了或空了立即返回，需要等待的由调用者自己休眠
+template <typename T>
+class mpmc_ring
+{
+public:
+    // 容量向上取到2的幂
+    explicit mpmc_ring(size_t capacity)
+    {
+        if (capacity < 2)
+            capacity = 2;
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_cells = new cell[size];
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_head.store(0, std::memory_order_relaxed);
+    }
+
+    ~mpmc_ring()
+    {
+        delete[] m_cells;
+    }
+
+    mpmc_ring(const mpmc_ring &) = delete;
+    mpmc_ring &operator=(const mpmc_ring &) = delete;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // 近似的元素个数，其他线程可能正在修改
+    size_t size() const
+    {
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        size_t head = m_head.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return 0 == size(); }
+
+    // 满了返回false，item不变
+    bool push(T &&item)
+    {
+        size_t pos;
+        if (1 != claim(m_tail, 0, 1, pos))
+            return false;
+        cell &c = m_cells[pos & m_mask];
+        c.value = std::move(item);
+        c.seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool push(const T &item)
+    {
+        T copy(item);
+        return push(std::move(copy));
+    }
+
+    // 空的返回false
+    bool pop(T &item)
+    {
+        size_t pos;
+        if (1 != claim(m_head, 1, 1, pos))
+            return false;
+        cell &c = m_cells[pos & m_mask];
+        item = std::move(c.value);
+        c.seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 一次CAS抢下连续的若干格，依次放入items[0..n)中的前若干个，返回放入的个数，满了返回0
+    size_t push_batch(T *items, size_t n)
+    {
+        size_t pos;
+        size_t cnt = claim(m_tail, 0, n, pos);
+        for (size_t i = 0; i < cnt; ++i)
+        {
+            cell &c = m_cells[(pos + i) & m_mask];
+            c.value = std::move(items[i]);
+            c.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return cnt;
+    }
+
+    // 一次CAS取出最多n个连续的元素，返回取出的个数，空的返回0
+    size_t pop_batch(T *items, size_t n)
+    {
+        size_t pos;
+        size_t cnt = claim(m_head, 1, n, pos);
+        for (size_t i = 0; i < cnt; ++i)
+        {
+            cell &c = m_cells[(pos + i) & m_mask];
+            items[i] = std::move(c.value);
+            c.seq.store(pos + i + m_mask + 1, std::memory_order_release);
+        }
+        return cnt;
+    }
+
+private:
+    // 从index抢下最多n个连续的、序号等于下标+ready的格子，起点放在pos，返回抢到的个数
+    // 格子的序号只有在index越过它之后才会变，CAS成功时检查过的格子一定还是就绪的
+    size_t claim(std::atomic<size_t> &index, size_t ready, size_t n, size_t &pos)
+    {
+        pos = index.load(std::memory_order_relaxed);
+        while (true)
+        {
+            size_t cnt = 0;
+            while (cnt < n)
+            {
+                size_t seq = m_cells[(pos + cnt) & m_mask].seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)(pos + cnt + ready);
+                if (diff != 0)
+                {
+                    // 第一格就被别的线程抢先，下标已经变了，重新读
+                    if (0 == cnt && diff > 0)
+                        cnt = SIZE_MAX;
+                    break;
+                }
+                ++cnt;
+            }
+            if (SIZE_MAX == cnt)
+            {
+                pos = index.load(std::memory_order_relaxed);
+                continue;
+            }
+            // 第一格还没就绪:push时是满了，pop时是空的
+            if (0 == cnt)
+                return 0;
+            if (index.compare_exchange_weak(pos, pos + cnt, std::memory_order_relaxed))
+                return cnt;
+        }
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    cell *m_cells;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_tail; // 下一个push的位置
+    alignas(64) std::atomic<size_t> m_head; // 下一个pop的位置
+    char m_pad[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif
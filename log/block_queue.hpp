@@ -8,204 +8,116 @@
 #include <cstring>
 #include <ctime>
 #include <cstdarg>
+#include <atomic>
 #include "../lock/locker.hpp"
+#include "../lock/mpmc_ring.hpp"
 
 using namespace std;
 
 // 阻塞的循环队列类
 // 封装了生产者-消费者模型，其中push成员是生产者，pop成员是消费者
+// 元素放在无锁的mpmc_ring里，push和pop不加锁，元素移动进出不拷贝
+// 队列空时消费者在futex上休眠，生产者只在有消费者休眠时才唤醒，平时push不需要系统调用
 template <class T>
 class block_queue
 {
 public:
-    block_queue(int max_size = 1000)
+    // 容量向上取到2的幂
+    block_queue(int max_size = 1000) : m_ring(max_size > 0 ? max_size : 1), m_waiters(0)
     {
         if (max_size <= 0)
         {
             exit(-1);
         }
-        // 构造函数创建循环队列
-        m_max_size = max_size;
-        m_array = new T[max_size];
-        m_size = 0;
-        m_front = -1;
-        m_back = -1;
     }
 
-    void clear()
+    // 判断队列是否满了
+    bool full() const
     {
-        m_bq_mutex.lock();
-        m_size = 0;
-        m_front = -1;
-        m_back = -1;
-        m_bq_mutex.unlock();
+        return m_ring.size() >= m_ring.capacity();
     }
 
-    ~block_queue()
+    // 判断队列是否为空
+    bool empty() const
     {
-        m_bq_mutex.lock();
-        if (m_array != NULL)
-            delete[] m_array;
-
-        m_bq_mutex.unlock();
+        return m_ring.empty();
     }
 
-    // 判断队列是否满了
-    bool full()
+    int size() const
     {
-        m_bq_mutex.lock();
-        if (m_size >= m_max_size)
-        {
-
-            m_bq_mutex.unlock();
-            return true;
-        }
-        m_bq_mutex.unlock();
-        return false;
+        return m_ring.size();
     }
 
-    // 判断队列是否为空
-    bool empty()
+    int max_size() const
     {
-        m_bq_mutex.lock();
-        if (0 == m_size)
-        {
-            m_bq_mutex.unlock();
-            return true;
-        }
-        m_bq_mutex.unlock();
-        return false;
+        return m_ring.capacity();
     }
 
-    // 返回队首元素
-    bool front(T &value)
+    // 往队列添加元素，满了返回false
+    // 有线程在等待时唤醒一个，没有线程等待时不需要唤醒
+    bool push(const T &item)
     {
-        m_bq_mutex.lock();
-        if (0 == m_size)
-        {
-            m_bq_mutex.unlock();
+        if (!m_ring.push(item))
             return false;
-        }
-        value = m_array[m_front];
-        m_bq_mutex.unlock();
+        wake_one();
         return true;
     }
 
-    // 返回队尾元素
-    bool back(T &value)
+    // 满了返回false，item不变
+    bool push(T &&item)
     {
-        m_bq_mutex.lock();
-        if (0 == m_size)
-        {
-            m_bq_mutex.unlock();
+        if (!m_ring.push(std::move(item)))
             return false;
-        }
-        value = m_array[m_back];
-        m_bq_mutex.unlock();
+        wake_one();
         return true;
     }
 
-    int size()
+    // pop时,如果当前队列没有元素,将会一直等待
+    bool pop(T &item)
     {
-        int tmp = 0;
-
-        m_bq_mutex.lock();
-        tmp = m_size;
-
-        m_bq_mutex.unlock();
-        return tmp;
+        while (!m_ring.pop(item))
+            wait(-1);
+        return true;
     }
 
-    int max_size()
+    // 增加了超时处理
+    bool pop(T &item, int ms_timeout)
     {
-        int tmp = 0;
-
-        m_bq_mutex.lock();
-        tmp = m_max_size;
-
-        m_bq_mutex.unlock();
-        return tmp;
+        if (m_ring.pop(item))
+            return true;
+        wait(ms_timeout);
+        return m_ring.pop(item);
     }
 
-    // 往队列添加元素，需要将所有使用队列的线程先唤醒
-    // 当有元素push进队列,相当于生产者生产了一个元素
-    // 若当前没有线程等待条件变量,则唤醒无意义
-    bool push(const T &item)
+    // 不等待，取出最多n个元素，返回取出的个数
+    int pop_batch(T *items, int n)
     {
-        m_bq_mutex.lock();
-        // 循环队列是满的
-        if (m_size >= m_max_size)
-        {
-            m_bq_cond.broadcast();
-            m_bq_mutex.unlock();
-            return false;
-        }
-        // 取余运算就是实现循环队列的方法
-        m_back = (m_back + 1) % m_max_size;
-        m_array[m_back] = item;
-        m_size++;
-        m_bq_cond.broadcast();
-        m_bq_mutex.unlock();
-        return true;
+        return m_ring.pop_batch(items, n);
     }
 
-    // pop时,如果当前队列没有元素,将会等待条件变量
-    bool pop(T &item)
+private:
+    // 先登记再检查一次，之后push的元素一定会唤醒等待的线程；检查之后push的会改变m_wakeup的值，wait立即返回
+    void wait(int ms_timeout)
     {
-        m_bq_mutex.lock();
-        while (m_size <= 0)
-        {
-            if (!m_bq_cond.wait(m_bq_mutex.get()))
-            {
-                m_bq_mutex.unlock();
-                return false;
-            }
-        }
-        m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
-        m_size--;
-        m_bq_mutex.unlock();
-        return true;
+        uint32_t seq = m_wakeup.load();
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_ring.empty())
+            m_wakeup.wait(seq, ms_timeout);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
     }
 
-    // 增加了超时处理
-    bool pop(T &item, int ms_timeout)
+    void wake_one()
     {
-        struct timespec t = {0, 0};
-        struct timeval now = {0, 0};
-        gettimeofday(&now, NULL);
-        m_bq_mutex.lock();
-        if (m_size <= 0)
-        {
-            t.tv_sec = now.tv_sec + ms_timeout / 1000;
-            t.tv_nsec = (ms_timeout % 1000) * 1000;
-            if (!m_bq_cond.timewait(m_bq_mutex.get(), t))
-            {
-                m_bq_mutex.unlock();
-                return false;
-            }
-        }
-        if (m_size <= 0)
-        {
-            m_bq_mutex.unlock();
-            return false;
-        }
-        m_front = (m_front + 1) % m_max_size;
-        item = m_array[m_front];
-        m_size--;
-        m_bq_mutex.unlock();
-        return true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) > 0)
+            m_wakeup.wake(1);
     }
 
 private:
-    locker m_bq_mutex;
-    cond m_bq_cond;
-
-    T *m_array;
-    int m_size;
-    int m_max_size;
-    int m_front;
-    int m_back;
+    mpmc_ring<T> m_ring;
+    futex m_wakeup;              // 消费者在这里休眠
+    std::atomic<int> m_waiters;  // 正在休眠或准备休眠的消费者数
 };
 
 #endif
@@ -143,20 +143,19 @@ void Log::write_log(int level, const char *format, ...)
                      my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
                      my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
 
-    int m = vsnprintf(m_log_out_buf + n, m_log_buf_size - 1, format, valst);
+    int m = vsnprintf(m_log_out_buf + n, m_log_buf_size - n - 1, format, valst);
+    // 超长的内容被截断，留出换行符和\0的位置
+    if (m > m_log_buf_size - n - 2)
+        m = m_log_buf_size - n - 2;
     m_log_out_buf[n + m] = '\n';
     m_log_out_buf[n + m + 1] = '\0';
     log_str = m_log_out_buf;
 
     m_log_mutex.unlock();
     // 若m_is_async为true表示异步，默认为同步
-    // 若异步,则将日志信息加入阻塞队列,
-    if (m_log_is_async && !m_log_queue->full())
-    {
-        m_log_queue->push(log_str);
-    }
-    // 同步则加锁向文件中写
-    else
+    // 若异步,则将日志信息移动到阻塞队列,
+    // 同步或者队列满了(push失败，log_str不变)则加锁向文件中写
+    if (!m_log_is_async || !m_log_queue->push(std::move(log_str)))
     {
         m_log_mutex.lock();
         fputs(log_str.c_str(), m_log_fp);
@@ -38,16 +38,20 @@ private:
 
     void *async_write_log()
     {
-        string single_log;
-        // 从阻塞队列中取出一个日志string，写入文件
-        while (m_log_queue->pop(single_log))
+        string logs[LOG_BATCH];
+        // 从阻塞队列中取出一个日志string，连同已经在队列里的一批一起写入文件，只加一次锁
+        while (m_log_queue->pop(logs[0]))
         {
+            int n = 1 + m_log_queue->pop_batch(logs + 1, LOG_BATCH - 1);
             m_log_mutex.lock();
-            fputs(single_log.c_str(), m_log_fp);
+            for (int i = 0; i < n; ++i)
+                fputs(logs[i].c_str(), m_log_fp);
             m_log_mutex.unlock();
         }
     }
 
+    static const int LOG_BATCH = 64; // 异步写日志时一次最多写入的条数
+
 private:
     char m_log_path[128];               // 路径名
     char m_log_name[128];               // log文件名
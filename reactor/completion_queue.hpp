@@ -0,0 +1,64 @@
+#ifndef COMPLETION_QUEUE_HPP
+#define COMPLETION_QUEUE_HPP
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <exception>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "../lock/locker.hpp"
+
+// 完成队列:工作线程处理完一个请求后把(请求,事件)交回事件循环
+// 多个工作线程push，事件循环通过eventfd得知有新的完成项后一次性drain
+template <typename T>
+class completion_queue
+{
+public:
+    completion_queue()
+    {
+        m_eventfd = eventfd(0, EFD_CLOEXEC);
+        if (m_eventfd < 0)
+        {
+            throw std::exception();
+        }
+    }
+
+    ~completion_queue()
+    {
+        close(m_eventfd);
+    }
+
+    // 工作线程调用，ev为请求接下来要等待的事件
+    void push(T *item, int ev)
+    {
+        m_cq_mutex.lock();
+        m_items.emplace_back(item, ev);
+        m_cq_mutex.unlock();
+
+        uint64_t one = 1;
+        ::write(m_eventfd, &one, sizeof(one));
+    }
+
+    // 事件循环调用，取出当前全部完成项
+    void drain(std::vector<std::pair<T *, int>> &items)
+    {
+        items.clear();
+        m_cq_mutex.lock();
+        items.swap(m_items);
+        m_cq_mutex.unlock();
+    }
+
+    // 可读即表示有完成项
+    int get_fd() const
+    {
+        return m_eventfd;
+    }
+
+private:
+    locker m_cq_mutex;
+    std::vector<std::pair<T *, int>> m_items;
+    int m_eventfd;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include <sys/eventfd.h>
+
+#include "sub_reactor.h"
+#include "../webserver/webserver.h"
+
+sub_reactor::sub_reactor() : m_id(0), m_epollfd(-1), m_wakeup_fd(-1), m_listenfd(-1), m_load(0), m_server(nullptr),
+                             m_thread(0), m_events(nullptr), m_stop(false), m_close_log(0)
+{
+}
+
+// 通知事件循环退出并等待线程结束，之后才能释放连接数组
+sub_reactor::~sub_reactor()
+{
+    if (m_thread)
+    {
+        m_stop = true;
+        uint64_t one = 1;
+        ::write(m_wakeup_fd, &one, sizeof(one));
+        pthread_join(m_thread, nullptr);
+    }
+    if (m_listenfd != -1)
+        close(m_listenfd);
+    if (m_wakeup_fd != -1)
+        close(m_wakeup_fd);
+    if (m_epollfd != -1)
+        close(m_epollfd);
+    delete[] m_events;
+}
+
+// 创建epoll、唤醒用的eventfd和定时用的timerfd
+void sub_reactor::init(WebServer *server, int id, int tick_ms, int close_log)
+{
+    m_server = server;
+    m_id = id;
+    m_close_log = close_log;
+    m_utils.init(tick_ms);
+
+    m_epollfd = epoll_create(5);
+    assert(m_epollfd != -1);
+    m_events = new epoll_event[MAX_EVENT_NUMBER];
+
+    // eventfd相当于一个计数器，主reactor写入后本reactor的epoll上可读
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK);
+    assert(m_wakeup_fd != -1);
+    m_utils.addfd(m_epollfd, m_wakeup_fd, false, 0);
+
+    // 每个reactor有自己的timerfd，只tick自己的时间轮
+    m_utils.addfd(m_epollfd, m_utils.create_timerfd(), false, 0);
+
+    // Reactor模式下工作线程把本reactor的连接交回来
+    m_utils.addfd(m_epollfd, m_completions.get_fd(), false, 0);
+}
+
+// 分片模式:本reactor自己监听一个SO_REUSEPORT的socket
+void sub_reactor::listen_on(int listenfd, int trigger_mode)
+{
+    m_listenfd = listenfd;
+    m_utils.addfd(m_epollfd, m_listenfd, false, trigger_mode);
+}
+
+// 创建事件循环线程
+void sub_reactor::start()
+{
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0)
+    {
+        m_thread = 0;
+        throw std::exception();
+    }
+}
+
+// 主reactor调用，把新连接交给本reactor
+void sub_reactor::add_conn(int connfd, const sockaddr_in &client_address)
+{
+    m_pending_lock.lock();
+    m_pending_conns.emplace_back(connfd, client_address);
+    m_pending_lock.unlock();
+    m_load++;
+
+    uint64_t one = 1;
+    ::write(m_wakeup_fd, &one, sizeof(one));
+}
+
+void *sub_reactor::worker(void *arg)
+{
+    auto *reactor = (sub_reactor *)arg;
+    reactor->run();
+    return reactor;
+}
+
+// 注册主reactor交过来的新连接
+void sub_reactor::deal_new_conns()
+{
+    // 先清空eventfd计数再取队列，保证不会漏掉唤醒
+    uint64_t cnt;
+    ::read(m_wakeup_fd, &cnt, sizeof(cnt));
+
+    std::list<std::pair<int, sockaddr_in>> conns;
+    m_pending_lock.lock();
+    conns.swap(m_pending_conns);
+    m_pending_lock.unlock();
+
+    for (auto &conn : conns)
+    {
+        m_server->init_timer(conn.first, conn.second, m_epollfd, m_utils.m_timer_wheel,
+                             1 == m_server->m_actormodel ? &m_completions : nullptr, &m_load);
+    }
+}
+
+// 从reactor的事件回环，只处理分到本reactor的连接
+void sub_reactor::run()
+{
+    while (!m_stop)
+    {
+        bool timeout = false;
+        int number = epoll_wait(m_epollfd, m_events, MAX_EVENT_NUMBER, -1);
+        if (number < 0 && errno != EINTR)
+        {
+            LOG_ERROR("reactor %d epoll failure", m_id);
+            break;
+        }
+
+        for (int i = 0; i < number; i++)
+        {
+            int sockfd = m_events[i].data.fd;
+            // 分片模式下本reactor自己accept，新连接留在本reactor
+            if (sockfd == m_listenfd)
+            {
+                m_server->deal_client(m_listenfd, this);
+            }
+            // 主reactor分发了新连接
+            else if (sockfd == m_wakeup_fd)
+            {
+                deal_new_conns();
+            }
+            // 工作线程处理完了一批连接
+            else if (sockfd == m_completions.get_fd())
+            {
+                m_server->deal_completions(m_completions, m_done);
+            }
+            // timerfd到期，本轮读写处理完后再tick
+            else if (sockfd == m_utils.m_timerfd)
+            {
+                timeout = true;
+            }
+            // 处理异常事件
+            else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                m_server->deal_timer(m_server->m_client_datas[sockfd].client_timer, sockfd);
+            }
+            // 处理读操作
+            else if (m_events[i].events & EPOLLIN)
+            {
+                m_server->deal_read(sockfd);
+            }
+            // 处理写操作
+            else if (m_events[i].events & EPOLLOUT)
+            {
+                m_server->deal_write(sockfd);
+            }
+        }
+
+        if (timeout)
+        {
+            m_utils.timer_handler();
+        }
+    }
+}
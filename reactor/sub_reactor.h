@@ -0,0 +1,68 @@
+#ifndef SUB_REACTOR_H
+#define SUB_REACTOR_H
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <list>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "../lock/locker.hpp"
+#include "../timer/timer.h"
+#include "completion_queue.hpp"
+
+class WebServer;
+
+// 从reactor：主reactor只负责accept，新连接分发给从reactor
+// 每个从reactor在自己的线程中运行一个epoll，独占分到的连接(m_http_conns/m_client_datas中对应的fd)和时间轮
+class sub_reactor
+{
+public:
+    sub_reactor();
+    ~sub_reactor();
+
+    // 创建epoll、唤醒用的eventfd和定时用的timerfd，tick_ms为定时器时间片(毫秒)
+    void init(WebServer *server, int id, int tick_ms, int close_log);
+
+    // 分片模式:本reactor自己监听一个SO_REUSEPORT的socket，需在start前调用
+    void listen_on(int listenfd, int trigger_mode);
+
+    // 创建事件循环线程
+    void start();
+
+    // 主reactor调用，把新连接交给本reactor，线程安全
+    void add_conn(int connfd, const sockaddr_in &client_address);
+
+    // 当前负责的连接数，用于最小负载分发
+    int load() const { return m_load.load(std::memory_order_relaxed); }
+
+private:
+    static void *worker(void *arg); // 线程执行函数(静态)
+    void run();
+
+    // 注册主reactor交过来的新连接
+    void deal_new_conns();
+
+public:
+    int m_id;        // reactor编号
+    int m_epollfd;   // 本reactor的epoll
+    int m_wakeup_fd; // eventfd，主reactor写入以唤醒本reactor
+    int m_listenfd;  // 分片模式下本reactor的监听socket，否则为-1
+    Utils m_utils;   // 本reactor私有的时间轮和timerfd
+    completion_queue<http_conn> m_completions; // Reactor模式下工作线程交回本reactor连接的队列
+    std::atomic<int> m_load;                   // 本reactor负责的连接数，分发时加一，cb_func关闭连接时减一
+
+private:
+    WebServer *m_server;
+    pthread_t m_thread;
+    epoll_event *m_events;
+    std::vector<std::pair<http_conn *, int>> m_done; // drain出来的完成项
+    std::list<std::pair<int, sockaddr_in>> m_pending_conns; // 待注册的新连接
+    locker m_pending_lock;                                  // 保护m_pending_conns
+    std::atomic<bool> m_stop;
+    int m_close_log;
+};
+
+#endif
@@ -0,0 +1,632 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <cstring>
+#include <cerrno>
+
+#include "uring_loop.h"
+#include "../webserver/webserver.h"
+
+/************************** io_uring的系统调用封装 **************************/
+
+uring::uring() : m_ring_fd(-1), m_sq_ptr(MAP_FAILED), m_sq_size(0), m_sqes((io_uring_sqe *)MAP_FAILED), m_sqes_size(0),
+                 m_sqe_tail(0), m_sqe_head(0), m_cq_ptr(MAP_FAILED), m_cq_size(0)
+{
+}
+
+uring::~uring()
+{
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_ring_fd != -1)
+        close(m_ring_fd);
+}
+
+// 创建io_uring实例并映射提交/完成队列
+bool uring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 完成队列开大一些，避免突发的完成事件溢出
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    m_ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (m_ring_fd < 0)
+        return false;
+
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // 新内核提交队列和完成队列可以一次映射
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cq_size > m_sq_size)
+            m_sq_size = m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+        return false;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        m_cq_ptr = m_sq_ptr;
+    }
+    else
+    {
+        m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+
+    // 提交队列的数组和提交项一一对应，之后只需要移动tail
+    unsigned *sq_array = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; ++i)
+        sq_array[i] = i;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    m_sqe_head = m_sqe_tail = *m_sq_tail;
+    return true;
+}
+
+// 查询内核支持的操作码，老内核不支持IORING_REGISTER_PROBE时也返回false
+bool uring::probe(const uint8_t *ops, int n)
+{
+    // 操作码是一个字节，按最多256个分配
+    std::vector<char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe *p = (io_uring_probe *)buf.data();
+    if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PROBE, p, 256) < 0)
+        return false;
+    for (int i = 0; i < n; ++i)
+    {
+        if (ops[i] > p->last_op || !(p->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+// 取一个空闲的提交队列项
+io_uring_sqe *uring::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries)
+    {
+        submit(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries)
+            return nullptr;
+    }
+
+    io_uring_sqe *sqe = &m_sqes[m_sqe_tail & *m_sq_mask];
+    ++m_sqe_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// 一次io_uring_enter完成批量提交和等待
+int uring::submit(unsigned wait_nr)
+{
+    if (m_sqe_head != m_sqe_tail)
+    {
+        // 发布新的tail，内核在io_uring_enter中消费
+        __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+        m_sqe_head = m_sqe_tail;
+    }
+
+    unsigned to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    return (int)syscall(__NR_io_uring_enter, m_ring_fd, to_submit, wait_nr, flags, nullptr, 0);
+}
+
+// 取下一个完成事件
+io_uring_cqe *uring::peek_cqe()
+{
+    unsigned head = *m_cq_head;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return nullptr;
+    return &m_cqes[head & *m_cq_mask];
+}
+
+// 归还完成事件
+void uring::cqe_seen()
+{
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/************************** io_uring事件循环 **************************/
+
+// io_uring模式的定时器回调
+// 连接上总挂着一个recv或writev，或者在工作线程中处理，这里不能直接close
+// 只shutdown让挂着的操作失败返回，由事件循环在完成事件中关闭；定时器节点随后会被tick删除
+static void uring_cb_func(client_data *user_data)
+{
+    shutdown(user_data->client_sockfd, SHUT_RDWR);
+    user_data->client_timer = nullptr;
+}
+
+uring_loop::uring_loop() : m_server(nullptr), m_listenfd(-1), m_timerfd(-1), m_signalfd(-1), m_recv_bufs(nullptr), m_gens(nullptr),
+                           m_wakeup_cnt(0), m_expirations(0), m_accept_paused(false), m_stop(false), m_close_log(0)
+{
+}
+
+uring_loop::~uring_loop()
+{
+    delete[] m_recv_bufs;
+    delete[] m_gens;
+}
+
+// 把操作类型、fd的代数和fd编码进user_data
+uint64_t uring_loop::pack(int op, uint32_t gen, int fd)
+{
+    return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+}
+
+void uring_loop::init(WebServer *server, int listenfd, int timerfd, int signalfd, int close_log)
+{
+    m_server = server;
+    m_listenfd = listenfd;
+    m_timerfd = timerfd;
+    m_signalfd = signalfd;
+    m_close_log = close_log;
+
+    if (!m_ring.init(4096))
+    {
+        LOG_ERROR("io_uring_setup failed, errno is:%d", errno);
+        throw std::exception();
+    }
+
+    // 用到的操作码，IORING_OP_PROVIDE_BUFFERS需要5.7以上
+    static const uint8_t ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_WRITEV, IORING_OP_READ, IORING_OP_PROVIDE_BUFFERS};
+    if (!m_ring.probe(ops, sizeof(ops)))
+    {
+        LOG_ERROR("%s", "io_uring lacks required opcodes (needs Linux 5.7+), use -i 0");
+        throw std::exception();
+    }
+
+    m_recv_bufs = new char[RECV_BUF_NUM * RECV_BUF_SIZE];
+    m_gens = new uint32_t[MAX_FD]();
+
+    // 一次把整个缓冲区组交给内核，之后每消费一块就归还一块
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = RECV_BUF_NUM;
+    sqe->addr = (uint64_t)m_recv_bufs;
+    sqe->len = RECV_BUF_SIZE;
+    sqe->off = 0;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = pack(OP_PROVIDE, 0, 0);
+
+    submit_accept();
+    if (!check_setup())
+        throw std::exception();
+
+    submit_wakeup();
+    submit_timer();
+    submit_signal();
+}
+
+// 提交缓冲区组和multishot accept，检查内核是否接受
+// 两者都在提交时就地处理:缓冲区组马上完成，不支持multishot accept(5.19以下)时准备阶段就以-EINVAL完成
+// 支持时accept挂起，除非此时恰好有连接到达
+bool uring_loop::check_setup()
+{
+    if (m_ring.submit(0) < 0)
+    {
+        LOG_ERROR("io_uring_enter failed, errno is:%d", errno);
+        return false;
+    }
+
+    bool ok = true;
+    io_uring_cqe *cqe;
+    while ((cqe = m_ring.peek_cqe()) != nullptr)
+    {
+        int op = (int)(cqe->user_data >> 56);
+        if (OP_PROVIDE == op && cqe->res < 0)
+        {
+            LOG_ERROR("provide buffers failed:%d, use -i 0", cqe->res);
+            ok = false;
+        }
+        else if (OP_ACCEPT == op && -EINVAL == cqe->res && !(cqe->flags & IORING_CQE_F_MORE))
+        {
+            LOG_ERROR("%s", "multishot accept is not supported (needs Linux 5.19+), use -i 0");
+            ok = false;
+        }
+        else if (OP_ACCEPT == op)
+        {
+            deal_accept(cqe);
+        }
+        m_ring.cqe_seen();
+    }
+    return ok;
+}
+
+// multishot accept:一次提交，每个新连接产生一个完成事件
+void uring_loop::submit_accept()
+{
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+    {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = pack(OP_ACCEPT, 0, m_listenfd);
+}
+
+// 从缓冲区组接收数据，可能挂在writev后面
+// 读缓冲区按块增长，每次最多收一个缓冲区，超过请求大小上限时由deal_recv关闭连接
+void uring_loop::submit_recv(int fd)
+{
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+    {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        close_conn(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = RECV_BUF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = pack(OP_RECV, m_gens[fd], fd);
+}
+
+// 发送响应报文，长连接在writev后链接一个recv
+void uring_loop::submit_write(int fd)
+{
+    http_conn &conn = m_server->m_http_conns[fd];
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+    {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        close_conn(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    int cnt = 0;
+    sqe->addr = (uint64_t)conn.send_iovec(cnt);
+    sqe->len = cnt;
+    sqe->user_data = pack(OP_WRITE, m_gens[fd], fd);
+
+    // writev没有全部写完时链接中断，recv以-ECANCELED返回
+    // 读缓冲区里还有没解析的流水线请求时不链接recv，发送完毕后先交给工作线程解析，避免recv和解析同时改读缓冲区
+    // 分块响应或HTTP/2的正文还没有生成完时也不链接，最后一批提交时再链接
+    if (conn.m_linger && conn.m_checked_idx == conn.m_read_idx && !conn.more_to_send())
+    {
+        sqe->flags |= IOSQE_IO_LINK;
+        submit_recv(fd);
+    }
+}
+
+// 等待工作线程的完成通知
+void uring_loop::submit_wakeup()
+{
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_completions.get_fd();
+    sqe->addr = (uint64_t)&m_wakeup_cnt;
+    sqe->len = sizeof(m_wakeup_cnt);
+    sqe->user_data = pack(OP_WAKEUP, 0, 0);
+}
+
+// 等待timerfd到期
+void uring_loop::submit_timer()
+{
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_timerfd;
+    sqe->addr = (uint64_t)&m_expirations;
+    sqe->len = sizeof(m_expirations);
+    sqe->user_data = pack(OP_TIMER, 0, 0);
+}
+
+// 等待signalfd上的退出信号
+void uring_loop::submit_signal()
+{
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_signalfd;
+    sqe->addr = (uint64_t)m_signals;
+    sqe->len = sizeof(m_signals);
+    sqe->user_data = pack(OP_SIGNAL, 0, 0);
+}
+
+// 把一块接收缓冲区还给内核
+void uring_loop::provide_buffer(int bid)
+{
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = (uint64_t)(m_recv_bufs + (size_t)bid * RECV_BUF_SIZE);
+    sqe->len = RECV_BUF_SIZE;
+    sqe->off = bid;
+    sqe->buf_group = RECV_BUF_GROUP;
+    sqe->user_data = pack(OP_PROVIDE, 0, 0);
+}
+
+// 新连接
+void uring_loop::deal_accept(io_uring_cqe *cqe)
+{
+    int connfd = cqe->res;
+
+    // 没有IORING_CQE_F_MORE说明multishot已经结束，需要重新提交
+    // 文件描述符用完时马上重新提交还会以同样的错误结束，等下一次定时器到期、连接关掉一些之后再提交
+    // -EINVAL是内核不接受这个accept，重新提交也一样
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        if (-EMFILE == connfd || -ENFILE == connfd)
+            m_accept_paused = true;
+        else if (-EINVAL != connfd)
+            submit_accept();
+    }
+
+    if (connfd < 0)
+    {
+        LOG_ERROR("%s:errno is:%d", "accept error", -connfd);
+        return;
+    }
+    if (http_conn::m_user_count >= MAX_FD)
+    {
+        m_server->m_utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+
+    // multishot accept不回填地址，只在需要打日志时查询
+    struct sockaddr_in client_address
+    {
+    };
+    if (0 == m_close_log)
+    {
+        socklen_t client_addr_length = sizeof(client_address);
+        getpeername(connfd, (struct sockaddr *)&client_address, &client_addr_length);
+    }
+
+    m_server->init_timer(connfd, client_address, -1, m_server->m_utils.m_timer_wheel, &m_completions);
+    m_server->m_client_datas[connfd].client_timer->cb_func = uring_cb_func;
+    submit_recv(connfd);
+}
+
+// 收到数据:拷贝到连接的读缓冲区，交给线程池解析
+void uring_loop::deal_recv(int fd, uint32_t gen, io_uring_cqe *cqe)
+{
+    int bid = -1;
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+        bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+    // 连接已经关闭，fd可能被复用，只需归还缓冲区
+    if (gen != (m_gens[fd] & 0xffffff))
+    {
+        if (bid >= 0)
+            provide_buffer(bid);
+        return;
+    }
+
+    // 链接在前面的writev没写完，由deal_write重新提交
+    if (cqe->res == -ECANCELED)
+        return;
+    // 缓冲区组暂时用完了，重新提交
+    if (cqe->res == -ENOBUFS)
+    {
+        submit_recv(fd);
+        return;
+    }
+    // 对方关闭连接或出错
+    if (cqe->res <= 0)
+    {
+        if (bid >= 0)
+            provide_buffer(bid);
+        close_conn(fd);
+        return;
+    }
+
+    http_conn &conn = m_server->m_http_conns[fd];
+    bool ok = conn.append(m_recv_bufs + (size_t)bid * RECV_BUF_SIZE, cqe->res);
+    provide_buffer(bid);
+    // 和http_conn::read()一样，请求超过上限就关闭连接
+    if (!ok)
+    {
+        close_conn(fd);
+        return;
+    }
+
+    LOG_INFO("deal with the client(%s)", inet_ntoa(conn.get_address()->sin_addr));
+    timer_node *timer = m_server->m_client_datas[fd].client_timer;
+    if (timer)
+        m_server->adjust_timer(timer);
+
+    m_server->m_thread_pool->append_p(&conn);
+}
+
+// writev完成:没写完继续写，写完了长连接等待下一个请求(recv已经链接提交)，短连接关闭
+void uring_loop::deal_write(int fd, uint32_t gen, io_uring_cqe *cqe)
+{
+    if (gen != (m_gens[fd] & 0xffffff))
+        return;
+
+    if (cqe->res < 0)
+    {
+        close_conn(fd);
+        return;
+    }
+
+    http_conn &conn = m_server->m_http_conns[fd];
+    timer_node *timer = m_server->m_client_datas[fd].client_timer;
+    if (timer)
+        m_server->adjust_timer(timer);
+
+    if (conn.advance_send(cqe->res) > 0)
+    {
+        submit_write(fd);
+        return;
+    }
+
+    LOG_INFO("send data to the client(%s)", inet_ntoa(conn.get_address()->sin_addr));
+    if (!conn.finish_send())
+        close_conn(fd);
+    // 这一批放不下的流水线请求，没有链接recv，交给工作线程接着解析
+    else if (conn.has_request())
+        m_server->m_thread_pool->append_p(&conn);
+}
+
+// 工作线程处理完的连接，根据process()要等待的事件提交recv或writev
+void uring_loop::deal_completions()
+{
+    submit_wakeup();
+
+    m_completions.drain(m_done);
+    for (auto &done : m_done)
+    {
+        http_conn *conn = done.first;
+        int fd = conn->m_sockfd;
+        // 请求不完整，继续接收
+        if (EPOLLIN == done.second)
+        {
+            submit_recv(fd);
+        }
+        // process_write失败，没有可发送的数据
+        else if (conn->m_bytes_to_send <= 0)
+        {
+            close_conn(fd);
+        }
+        else
+        {
+            submit_write(fd);
+        }
+    }
+}
+
+// timerfd到期，到期次数已经由io_uring读出，直接tick
+// 因文件描述符用完而暂停的accept在tick关掉超时连接之后重新提交
+void uring_loop::deal_timer(int len)
+{
+    if (len > 0)
+    {
+        m_server->m_utils.m_timer_wheel.tick();
+        LOG_INFO("%s", "client_timer tick");
+    }
+    if (m_accept_paused)
+    {
+        m_accept_paused = false;
+        submit_accept();
+    }
+    submit_timer();
+}
+
+// 处理signalfd读出的信号，SIGTERM和SIGINT退出
+void uring_loop::deal_signal(int len)
+{
+    for (int i = 0; len > 0 && i < len / (int)sizeof(signalfd_siginfo); ++i)
+    {
+        if (SIGTERM == m_signals[i].ssi_signo || SIGINT == m_signals[i].ssi_signo)
+        {
+            LOG_INFO("receive signal %d, stop server", m_signals[i].ssi_signo);
+            m_stop = true;
+        }
+    }
+    if (!m_stop)
+        submit_signal();
+}
+
+// 关闭连接，删除定时器，fd代数加一使迟到的完成事件失效
+void uring_loop::close_conn(int fd)
+{
+    client_data &user_data = m_server->m_client_datas[fd];
+    if (user_data.client_timer)
+    {
+        m_server->m_utils.m_timer_wheel.del_timer(user_data.client_timer);
+        user_data.client_timer = nullptr;
+    }
+    m_server->m_http_conns[fd].unmap();
+    ++m_gens[fd];
+    close(fd);
+    http_conn::m_user_count--;
+    LOG_INFO("close fd %d", fd);
+}
+
+// 事件回环:批量提交本轮产生的全部请求，同时等待至少一个完成事件
+void uring_loop::run()
+{
+    while (!m_stop)
+    {
+        int ret = m_ring.submit(1);
+        if (ret < 0 && errno != EINTR && errno != EBUSY)
+        {
+            LOG_ERROR("%s", "io_uring_enter failure");
+            break;
+        }
+
+        io_uring_cqe *cqe;
+        while ((cqe = m_ring.peek_cqe()) != nullptr)
+        {
+            uint64_t data = cqe->user_data;
+            int op = (int)(data >> 56);
+            uint32_t gen = (uint32_t)(data >> 32) & 0xffffff;
+            int fd = (int)(uint32_t)data;
+
+            switch (op)
+            {
+            case OP_ACCEPT:
+                deal_accept(cqe);
+                break;
+            case OP_RECV:
+                deal_recv(fd, gen, cqe);
+                break;
+            case OP_WRITE:
+                deal_write(fd, gen, cqe);
+                break;
+            case OP_WAKEUP:
+                deal_completions();
+                break;
+            case OP_TIMER:
+                deal_timer(cqe->res);
+                break;
+            case OP_SIGNAL:
+                deal_signal(cqe->res);
+                break;
+            case OP_PROVIDE:
+                if (cqe->res < 0)
+                    LOG_ERROR("provide buffers failed:%d", cqe->res);
+                break;
+            default:
+                break;
+            }
+            m_ring.cqe_seen();
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/signalfd.h>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+#include "completion_queue.hpp"
+#include "../http/http_conn.h"
+
+class WebServer;
+
+// io_uring的最小封装，直接使用系统调用，不依赖liburing
+// 提交队列项和数组下标一一对应，只在单个事件循环线程中使用
+class uring
+{
+public:
+    uring();
+    ~uring();
+
+    // 创建io_uring实例并映射提交/完成队列
+    bool init(unsigned entries);
+
+    // 内核是否支持全部n个操作码，通过IORING_REGISTER_PROBE(5.6以上)查询
+    bool probe(const uint8_t *ops, int n);
+
+    // 取一个空闲的提交队列项，队列满时先把已有的提交给内核
+    io_uring_sqe *get_sqe();
+
+    // 提交全部待提交项，并至少等待wait_nr个完成事件
+    int submit(unsigned wait_nr);
+
+    // 取下一个完成事件，没有则返回nullptr
+    io_uring_cqe *peek_cqe();
+
+    // 处理完一个完成事件后归还给内核
+    void cqe_seen();
+
+private:
+    int m_ring_fd;
+
+    // 提交队列
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned m_sq_entries;
+    io_uring_sqe *m_sqes;
+    size_t m_sqes_size;
+    unsigned m_sqe_tail; // 已分配出去的提交项
+    unsigned m_sqe_head; // 已提交给内核的提交项
+
+    // 完成队列
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    io_uring_cqe *m_cqes;
+};
+
+// io_uring事件循环，替代epoll的eventLoop(模拟Proactor)
+// 主线程用io_uring完成accept/recv/writev，工作线程仍然调用http_conn::process()解析请求、生成响应
+// multishot accept:一次提交持续接收新连接
+// 提供缓冲区的recv:内核从缓冲区组中挑一块接收数据，空闲连接不占用接收缓冲区
+// 长连接的writev后链接一个recv，发送完成后内核直接开始接收下一个请求
+class uring_loop
+{
+public:
+    uring_loop();
+    ~uring_loop();
+
+    // listenfd必须是阻塞的，timerfd和signalfd由io_uring读取
+    void init(WebServer *server, int listenfd, int timerfd, int signalfd, int close_log);
+
+    // 事件回环，收到SIGTERM或SIGINT后返回
+    void run();
+
+private:
+    // 完成事件的类型，和代数、fd一起编码进user_data
+    enum URING_OP
+    {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_WRITE,
+        OP_WAKEUP,
+        OP_TIMER,
+        OP_SIGNAL,
+        OP_PROVIDE
+    };
+
+    static uint64_t pack(int op, uint32_t gen, int fd);
+
+    void submit_accept();
+    void submit_recv(int fd);
+    void submit_write(int fd);
+    void submit_wakeup();
+    void submit_timer();
+    void submit_signal();
+    void provide_buffer(int bid);
+
+    // init中检查内核是否接受缓冲区组和multishot accept
+    bool check_setup();
+    void deal_accept(io_uring_cqe *cqe);
+    void deal_recv(int fd, uint32_t gen, io_uring_cqe *cqe);
+    void deal_write(int fd, uint32_t gen, io_uring_cqe *cqe);
+    void deal_completions();
+    void deal_timer(int len);
+    void deal_signal(int len);
+
+    // 关闭连接，删除定时器
+    void close_conn(int fd);
+
+public:
+    static const int RECV_BUF_NUM = 1024;                           // 缓冲区组中的缓冲区个数
+    static const int RECV_BUF_SIZE = http_conn::READ_BUFFER_SIZE;   // 每个缓冲区大小，和读缓冲区的一块一样大
+    static const int RECV_BUF_GROUP = 0;                            // 缓冲区组编号
+
+private:
+    WebServer *m_server;
+    uring m_ring;
+    int m_listenfd;
+    int m_timerfd;
+    int m_signalfd;
+    char *m_recv_bufs;  // 提供给内核的接收缓冲区组
+    uint32_t *m_gens;   // 每个fd的代数，fd关闭后加一，用于丢弃旧连接迟到的完成事件
+    completion_queue<http_conn> m_completions;
+    std::vector<std::pair<http_conn *, int>> m_done; // drain出来的完成项
+    uint64_t m_wakeup_cnt;
+    uint64_t m_expirations;           // timerfd的到期次数
+    signalfd_siginfo m_signals[16];
+    bool m_accept_paused; // 文件描述符用完，multishot accept等下一次定时器到期再提交
+    bool m_stop;
+    int m_close_log;
+};
+
+#endif
@@ -7,185 +7,521 @@
  * @date 2021-05-23
  * 
  */
-#include <list>
 #include <cstdio>
+#include <ctime>
+#include <climits>
 #include <exception>
+#include <atomic>
 #include <pthread.h>
+#include <sched.h>
 #include "../lock/locker.hpp"
-#include "../connpool/conn_pool.h"
+#include "../lock/mpmc_ring.hpp"
+#include "../log/block_queue.hpp"
+#include "work_deque.hpp"
 
 // 线程池类
+// 事件循环把请求放进无锁的注入队列，每个工作线程有自己的work_deque
+// 工作线程先取自己队列里的，没有时从注入队列取一个来处理，顺便搬一批到自己的队列，再没有就去别的线程的队列里偷
+// 没有任务的线程在futex上休眠，append只在有线程休眠时才唤醒一个，忙的时候入队不需要系统调用
+// 线程数在最少和最多之间伸缩:没有空闲线程、任务排队太久时增加一个，多于最少线程数时空闲太久的线程退出
+// 线程都被数据库之类的慢操作阻塞时，新增的线程可以接着处理后面的静态文件请求
+// 另有一条数据库通道:会阻塞在数据库上的请求由append_db交给固定数量的线程，不占用上面的线程，数据库变慢时静态文件请求不受影响
 template <typename T>
 class threadpool
 {
 public:
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_requests = 10000);
+    // 线程池的运行统计，用于调整线程数和队列大小
+    struct stats
+    {
+        int workers;      // 当前的工作线程数
+        int min_workers;  // 最少线程数
+        int max_workers;  // 最多线程数
+        int idle;         // 正在休眠的线程数
+        int queue_depth;  // 排队的任务数
+        int capacity;     // 注入队列的容量
+        long wait_avg_us; // 最近任务的排队时间，指数加权平均
+        long wait_max_us; // 启动以来最长的排队时间
+        long tasks;       // 处理过的任务数
+        long spawned;     // 因为排队太久增加过的线程数
+        long retired;     // 因为空闲太久退出过的线程数
+        int db_workers;      // 数据库通道的线程数
+        int db_queue_depth;  // 数据库通道排队的任务数
+        long db_tasks;       // 数据库通道处理过的任务数
+    };
+
+    // 启动时创建thread_number个线程，最多增加到max_thread_number个，小于thread_number时线程数固定
+    // 数据库通道固定db_thread_number个线程，为0时没有数据库通道
+    threadpool(int actor_model, int thread_number = 8, int max_thread_number = 32, int db_thread_number = 4, int max_requests = 10000);
     ~threadpool();
     bool append(T *request, int state);
     bool append_p(T *request);
+    // 请求已经解析完，交给数据库通道接着process()，没有数据库通道或者通道满了返回false，由调用者自己处理
+    bool append_db(T *request);
+    bool has_db_lane() const { return m_db_thread_number > 0; }
+    stats get_stats() const;
 
 private:
+    static const int BATCH = 32;                          // 从注入队列一次最多搬到自己队列的任务数
+    static const int64_t SPAWN_WAIT_NS = 2 * 1000 * 1000; // 排队超过2ms且没有空闲线程时增加线程，两次增加至少间隔这么久
+    static const int IDLE_TIMEOUT_MS = 10 * 1000;         // 多于最少线程数时，空闲超过10s的线程退出
+
+    // 线程槽位的状态，退出的线程由下一次启动或者析构时回收
+    enum SLOT_STATE
+    {
+        SLOT_EMPTY = 0,
+        SLOT_RUNNING,
+        SLOT_EXITED
+    };
+
+    // 传给工作线程的参数
+    struct worker_arg
+    {
+        threadpool *pool;
+        int id;
+    };
+
     static void *worker(void *arg); // 线程执行函数(静态)
-    [[noreturn]] void run();
+    void run(int self);
+    T *next_task(int self);   // 按自己的队列、注入队列、别的线程的队列的顺序找一个任务
+    bool has_task() const;    // 休眠之前再确认一次
+    void wake_one();          // 有线程在休眠时唤醒一个
+    void handle(T *request);  // 处理一个请求
+
+    bool push(T *request);        // 记下入队时间放进注入队列
+    int64_t record_wait(T *request); // 统计取出的任务排了多久，返回当前时间
+    void maybe_spawn(int64_t now, bool chained = false); // 排队太久时增加一个线程
+    bool spawn();                 // 在空的槽位上启动一个线程
+    bool retire();                // 线程数多于下限时减一，返回true表示这个线程可以退出
+    static int64_t now_ns();
+    void destroy();               // 停止全部线程，析构和构造失败时调用
+
+    static void *db_worker(void *arg); // 数据库通道的线程执行函数，参数是线程池
+    void run_db();
 
 private:
-    int m_thread_number;         // 线程池中的线程数
-    pthread_t *m_threads;        // 线程池的数组，其大小为m_thread_number
-    std::list<T *> m_work_queue; // 请求队列
-    int m_max_requests;          // 请求队列中允许的最大请求数
-    locker m_queue_lock;         // 请求队列的互斥锁
-    sem m_queue_sem;             // 是否有任务需要处理
-    connection_pool *m_connPool; // 数据库连接池
+    int m_min_threads;           // 最少线程数，启动时创建
+    int m_max_threads;           // 最多线程数，也是槽位数
+    pthread_t *m_threads;        // 每个槽位的线程
+    std::atomic<int> *m_slots;   // 每个槽位的状态
+    worker_arg *m_args;
+    locker m_spawn_lock;         // 启动和回收线程时加锁，只在增加线程和析构时用到
+    std::atomic<int> m_active;   // 运行中的线程数，不包括正在退出的
+    mpmc_ring<T *> m_injection;  // 事件循环放入的请求，多个事件循环线程push，多个工作线程pop
+    work_deque<T> *m_locals;     // 每个槽位的线程自己的队列
+    futex m_wakeup;              // 工作线程在这里休眠
+    std::atomic<int> m_parked;   // 正在休眠或准备休眠的线程数
     int m_actor_model;           // 模型切换(Reactor/Proactor)
+    std::atomic<bool> m_stop;    // 析构时通知工作线程退出
+
+    int m_db_thread_number;       // 数据库通道的线程数
+    int m_db_started;             // 已经启动的数据库通道线程数，析构时回收
+    pthread_t *m_db_threads;
+    block_queue<T *> m_db_queue;  // 数据库通道的请求，空指针通知线程退出
+
+    // 统计，都是近似值，不需要和任务严格同步
+    std::atomic<int64_t> m_wait_avg;     // 排队时间的指数加权平均(纳秒)
+    std::atomic<int64_t> m_wait_max;     // 最长排队时间(纳秒)
+    std::atomic<int64_t> m_last_dequeue; // 最近一次取出任务的时间，线程都阻塞住时不再更新
+    std::atomic<int64_t> m_last_spawn;   // 最近一次增加线程的时间
+    std::atomic<long> m_tasks;
+    std::atomic<long> m_spawned;
+    std::atomic<long> m_retired;
+    std::atomic<long> m_db_tasks;
 };
 
 template <typename T>
-threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread_number, int max_requests) : m_actor_model(actor_model), m_thread_number(thread_number),
-                                                                                                             m_max_requests(max_requests), m_threads(NULL), m_connPool(connPool)
+threadpool<T>::threadpool(int actor_model, int thread_number, int max_thread_number, int db_thread_number, int max_requests)
+    : m_min_threads(thread_number), m_max_threads(max_thread_number > thread_number ? max_thread_number : thread_number),
+      m_threads(NULL), m_slots(NULL), m_args(NULL), m_active(0), m_injection(max_requests > 0 ? max_requests : 1), m_locals(NULL),
+      m_parked(0), m_actor_model(actor_model), m_stop(false),
+      m_db_thread_number(db_thread_number), m_db_started(0), m_db_threads(NULL), m_db_queue(max_requests > 0 ? max_requests : 1),
+      m_wait_avg(0), m_wait_max(0), m_last_dequeue(now_ns()), m_last_spawn(0), m_tasks(0), m_spawned(0), m_retired(0), m_db_tasks(0)
 {
     // 输入检查
-    if (thread_number <= 0 || max_requests <= 0)
-        throw std::exception();
-    // 创建线程池数组
-    m_threads = new pthread_t[m_thread_number];
-    if (!m_threads)
+    if (thread_number <= 0 || db_thread_number < 0 || max_requests <= 0)
         throw std::exception();
+    // 槽位按最多线程数分配，增加线程时不需要再分配
+    m_threads = new pthread_t[m_max_threads];
+    m_slots = new std::atomic<int>[m_max_threads];
+    m_args = new worker_arg[m_max_threads];
+    m_locals = new work_deque<T>[m_max_threads];
+    for (int i = 0; i < m_max_threads; ++i)
+    {
+        m_slots[i].store(SLOT_EMPTY);
+        m_args[i].pool = this;
+        m_args[i].id = i;
+    }
     // 创建thread_number个线程(根据硬件性能)
     for (int i = 0; i < thread_number; ++i)
     {
-        // pthread_create函数原型中的第三个参数，为函数指针，指向处理线程函数的地址
-        // 若weoker是成员函数，则this指针会作为默认的参数被传进函数中，从而和线程函数参数(void*)不能匹配
-        // 静态函数worker没有this指针，不能调用成员函数，因此把this作为参数传给worker
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0)
+        if (!spawn())
         {
-            delete[] m_threads;
+            destroy();
             throw std::exception();
         }
-        // 设置为脱离线程，脱离后的线程在脱离后自动释放占用的资源
-        if (pthread_detach(m_threads[i]))
+    }
+    m_db_threads = new pthread_t[db_thread_number];
+    for (int i = 0; i < db_thread_number; ++i)
+    {
+        if (pthread_create(m_db_threads + i, NULL, db_worker, this) != 0)
         {
-            delete[] m_threads;
+            destroy();
             throw std::exception();
         }
+        ++m_db_started;
     }
 }
 
+// 工作线程会把处理结果交给事件循环的完成队列，必须在事件循环销毁之前析构线程池
 template <typename T>
 threadpool<T>::~threadpool()
 {
-    delete[] m_threads;
+    destroy();
 }
 
-// reactor模式下的请求入队
+// 通知全部工作线程退出并等待它们结束，释放槽位
 template <typename T>
-bool threadpool<T>::append(T *request, int state)
+void threadpool<T>::destroy()
 {
-    m_queue_lock.lock();
-    if (m_work_queue.size() >= m_max_requests)
+    m_stop.store(true);
+    m_wakeup.wake(INT_MAX);
+    m_spawn_lock.lock();
+    for (int i = 0; i < m_max_threads; ++i)
     {
-        m_queue_lock.unlock();
-        return false;
+        if (m_slots[i].load() != SLOT_EMPTY)
+            pthread_join(m_threads[i], NULL);
+        m_slots[i].store(SLOT_EMPTY);
     }
+    m_spawn_lock.unlock();
+    // 数据库通道的线程各取到一个空指针后退出，排在前面的请求被丢弃，队列总会空出位置
+    for (int i = 0; i < m_db_started; ++i)
+    {
+        while (!m_db_queue.push(nullptr))
+            sched_yield();
+    }
+    for (int i = 0; i < m_db_started; ++i)
+        pthread_join(m_db_threads[i], NULL);
+    m_db_started = 0;
+    delete[] m_db_threads;
+    m_db_threads = NULL;
+    delete[] m_threads;
+    delete[] m_slots;
+    delete[] m_args;
+    delete[] m_locals;
+    m_threads = NULL;
+    m_slots = NULL;
+    m_args = NULL;
+    m_locals = NULL;
+}
+
+template <typename T>
+int64_t threadpool<T>::now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
+// reactor模式下的请求入队
+template <typename T>
+bool threadpool<T>::append(T *request, int state)
+{
     request->m_io_state = state; // reactor模式要标记IO事件类别，0为读
-    m_work_queue.push_back(request);
-    m_queue_lock.unlock();
-    m_queue_sem.post();
-    return true;
+    return push(request);
 }
 
 // proactor模式下的请求入队(默认)
 template <typename T>
 bool threadpool<T>::append_p(T *request)
 {
-    m_queue_lock.lock();
-    if (m_work_queue.size() >= m_max_requests)
-    {
-        m_queue_lock.unlock();
+    return push(request);
+}
+
+template <typename T>
+bool threadpool<T>::append_db(T *request)
+{
+    if (0 == m_db_thread_number)
         return false;
-    }
-    m_work_queue.push_back(request);
-    m_queue_lock.unlock();
-    // 信号量提醒有新的任务要处理
-    m_queue_sem.post();
+    return m_db_queue.push(request);
+}
+
+template <typename T>
+bool threadpool<T>::push(T *request)
+{
+    int64_t now = now_ns();
+    request->m_queued_at = now;
+    if (!m_injection.push(request))
+        return false;
+    wake_one();
+    maybe_spawn(now);
     return true;
 }
 
+// 入队和读m_parked之间、登记休眠和检查队列之间都有全序屏障，两边至少有一边能看到对方
+template <typename T>
+void threadpool<T>::wake_one()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_parked.load(std::memory_order_relaxed) > 0)
+        m_wakeup.wake(1);
+}
+
+// 有空闲线程时不需要增加；最近的任务排队太久，或者有一段时间没有线程来取任务(都被阻塞住了)时增加一个
+// chained为true时由刚取到任务的线程调用，上一个新线程已经开始工作，不受两次增加的间隔限制
+template <typename T>
+void threadpool<T>::maybe_spawn(int64_t now, bool chained)
+{
+    if (m_parked.load(std::memory_order_relaxed) > 0 || m_active.load(std::memory_order_relaxed) >= m_max_threads)
+        return;
+    if (m_wait_avg.load(std::memory_order_relaxed) < SPAWN_WAIT_NS &&
+        now - m_last_dequeue.load(std::memory_order_relaxed) < SPAWN_WAIT_NS)
+        return;
+    // 新线程起作用之前不再增加
+    int64_t last = m_last_spawn.load(std::memory_order_relaxed);
+    if ((!chained && now - last < SPAWN_WAIT_NS) || !m_last_spawn.compare_exchange_strong(last, now))
+        return;
+    if (spawn())
+        m_spawned.fetch_add(1, std::memory_order_relaxed);
+}
+
+// 找一个空的槽位启动线程，已经退出的线程先回收
+template <typename T>
+bool threadpool<T>::spawn()
+{
+    bool ok = false;
+    m_spawn_lock.lock();
+    for (int i = 0; i < m_max_threads && !m_stop.load() && m_active.load() < m_max_threads; ++i)
+    {
+        int state = m_slots[i].load(std::memory_order_acquire);
+        if (SLOT_RUNNING == state)
+            continue;
+        if (SLOT_EXITED == state)
+            pthread_join(m_threads[i], NULL);
+        m_slots[i].store(SLOT_RUNNING);
+        m_active.fetch_add(1);
+        // pthread_create函数原型中的第三个参数，为函数指针，指向处理线程函数的地址
+        // 若weoker是成员函数，则this指针会作为默认的参数被传进函数中，从而和线程函数参数(void*)不能匹配
+        // 静态函数worker没有this指针，不能调用成员函数，因此把this和槽位号作为参数传给worker
+        if (pthread_create(m_threads + i, NULL, worker, m_args + i) != 0)
+        {
+            m_slots[i].store(SLOT_EMPTY);
+            m_active.fetch_sub(1);
+            break;
+        }
+        ok = true;
+        break;
+    }
+    m_spawn_lock.unlock();
+    return ok;
+}
+
+template <typename T>
+bool threadpool<T>::retire()
+{
+    int n = m_active.load();
+    while (n > m_min_threads)
+    {
+        if (m_active.compare_exchange_weak(n, n - 1))
+        {
+            m_retired.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
 // 工作线程运行的函数，它不断从工作队列中取出任务并执行之
 template <typename T>
 void *threadpool<T>::worker(void *arg)
 {
-    threadpool *pool = (threadpool *)arg;
+    worker_arg *wa = (worker_arg *)arg;
+    threadpool *pool = wa->pool;
     //线程池中每一个线程创建时都会调用run()，睡眠在队列中
-    pool->run();
+    pool->run(wa->id);
     return pool;
 }
 
-// 工作线程从请求队列中取出某个任务进行处理
+// 工作线程不断找任务处理，找不到时休眠
 template <typename T>
-[[noreturn]] void threadpool<T>::run()
+void threadpool<T>::run(int self)
 {
-    while (true)
+    // 线程池析构，未处理的请求直接丢弃
+    while (!m_stop.load(std::memory_order_acquire))
     {
-        // 线程建立之后，就等待信号量，当有连接进来之后，这些线程就会竞争处理连接
-        m_queue_sem.wait();
-        m_queue_lock.lock();
-        if (m_work_queue.empty())
+        T *request = next_task(self);
+        if (request)
         {
-            m_queue_lock.unlock();
+            // 取到的任务已经排了很久、后面还有任务时接着增加线程，不必等到下一次入队
+            int64_t now = record_wait(request);
+            if (now - request->m_queued_at >= SPAWN_WAIT_NS && has_task())
+                maybe_spawn(now, true);
+            handle(request);
             continue;
         }
-        // 获取队列中的第一个任务
-        T *request = m_work_queue.front();
-        m_work_queue.pop_front();
-        m_queue_lock.unlock();
-        if (!request)
+
+        // 先登记再检查一次，这之后入队的请求一定会唤醒某个线程；检查之后入队的会改变m_wakeup的值，wait立即返回
+        // 线程数多于下限时休眠有超时，超时后还是没有任务就退出
+        uint32_t seq = m_wakeup.load();
+        m_parked.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool timeout = false;
+        if (!has_task() && !m_stop.load(std::memory_order_acquire))
+            timeout = !m_wakeup.wait(seq, m_active.load() > m_min_threads ? IDLE_TIMEOUT_MS : -1);
+        m_parked.fetch_sub(1, std::memory_order_relaxed);
+        if (timeout && !has_task() && retire())
+            break;
+    }
+    // 之后不再访问线程池，由下一次spawn或者析构回收
+    m_slots[self].store(SLOT_EXITED, std::memory_order_release);
+}
+
+template <typename T>
+void *threadpool<T>::db_worker(void *arg)
+{
+    threadpool *pool = (threadpool *)arg;
+    pool->run_db();
+    return pool;
+}
+
+// 数据库通道的请求已经读完、解析完，直接接着process()
+template <typename T>
+void threadpool<T>::run_db()
+{
+    T *request = nullptr;
+    while (m_db_queue.pop(request) && request)
+    {
+        if (m_stop.load(std::memory_order_acquire))
             continue;
+        m_db_tasks.fetch_add(1, std::memory_order_relaxed);
+        request->process();
+    }
+}
 
-        // Reactor模式子线程负责处理IO
-        // 读事件先读取http::read()把数据读到缓存,再解析读进来的数据http::process();
-        // 写事件调用http::write()发送数据
-        if (1 == m_actor_model)
+template <typename T>
+int64_t threadpool<T>::record_wait(T *request)
+{
+    int64_t now = now_ns();
+    int64_t wait = now - request->m_queued_at;
+    // 所有线程都会写，隔一段时间才更新，减少缓存行的争用
+    if (now - m_last_dequeue.load(std::memory_order_relaxed) > SPAWN_WAIT_NS / 16)
+        m_last_dequeue.store(now, std::memory_order_relaxed);
+    int64_t avg = m_wait_avg.load(std::memory_order_relaxed);
+    m_wait_avg.store(avg + (wait - avg) / 8, std::memory_order_relaxed);
+    int64_t max = m_wait_max.load(std::memory_order_relaxed);
+    while (wait > max && !m_wait_max.compare_exchange_weak(max, wait, std::memory_order_relaxed))
+        ;
+    m_tasks.fetch_add(1, std::memory_order_relaxed);
+    return now;
+}
+
+template <typename T>
+typename threadpool<T>::stats threadpool<T>::get_stats() const
+{
+    stats st;
+    st.workers = m_active.load(std::memory_order_relaxed);
+    st.min_workers = m_min_threads;
+    st.max_workers = m_max_threads;
+    st.idle = m_parked.load(std::memory_order_relaxed);
+    st.queue_depth = m_injection.size();
+    for (int i = 0; i < m_max_threads; ++i)
+        st.queue_depth += m_locals[i].size();
+    st.capacity = m_injection.capacity();
+    st.wait_avg_us = m_wait_avg.load(std::memory_order_relaxed) / 1000;
+    st.wait_max_us = m_wait_max.load(std::memory_order_relaxed) / 1000;
+    st.tasks = m_tasks.load(std::memory_order_relaxed);
+    st.spawned = m_spawned.load(std::memory_order_relaxed);
+    st.retired = m_retired.load(std::memory_order_relaxed);
+    st.db_workers = m_db_thread_number;
+    st.db_queue_depth = m_db_queue.size();
+    st.db_tasks = m_db_tasks.load(std::memory_order_relaxed);
+    return st;
+}
+
+template <typename T>
+T *threadpool<T>::next_task(int self)
+{
+    work_deque<T> &local = m_locals[self];
+    T *request = local.steal();
+    if (request)
+        return request;
+
+    // 注入队列里有任务时取一个来处理，再按线程数均分搬一批到自己的队列，其他空闲的线程可以来偷
+    if (m_injection.pop(request))
+    {
+        // 只有自己往自己的队列里放，不超过剩余空间就一定放得下
+        int batch = m_injection.size() / m_active.load(std::memory_order_relaxed);
+        if (batch > BATCH)
+            batch = BATCH;
+        if (batch > work_deque<T>::capacity() - local.size())
+            batch = work_deque<T>::capacity() - local.size();
+        T *moved[BATCH];
+        int cnt = batch > 0 ? m_injection.pop_batch(moved, batch) : 0;
+        for (int i = 0; i < cnt; ++i)
+            local.push(moved[i]);
+        if (cnt > 0)
+            wake_one();
+        return request;
+    }
+
+    // 从其他槽位的队列偷一个，从自己的下一个开始，避免都去偷同一个；空的槽位队列也是空的
+    for (int i = 1; i < m_max_threads; ++i)
+    {
+        request = m_locals[(self + i) % m_max_threads].steal();
+        if (request)
+            return request;
+    }
+    return nullptr;
+}
+
+template <typename T>
+bool threadpool<T>::has_task() const
+{
+    if (m_injection.size() > 0)
+        return true;
+    for (int i = 0; i < m_max_threads; ++i)
+        if (m_locals[i].size() > 0)
+            return true;
+    return false;
+}
+
+// 处理一个请求
+template <typename T>
+void threadpool<T>::handle(T *request)
+{
+    // Reactor模式子线程负责处理IO
+    // 读事件先读取http::read()把数据读到缓存,再解析读进来的数据http::process();
+    // 写事件调用http::write()发送数据
+    // 处理结果通过notify()交回事件循环，主线程不用等待子线程
+    if (1 == m_actor_model)
+    {
+        // Reactor模式读取IO请求
+        if (0 == request->m_io_state)
         {
-            // Reactor模式读取IO请求
-            if (0 == request->m_io_state)
+            // 数据库连接由要写数据库的处理函数自己从连接池取
+            if (request->read())
             {
-                if (request->read())
-                {
-                    request->improv = 1;
-                    // 从连接池中获得一个连接
-                    connectionRAII mysql_conn(&request->m_mysql, m_connPool);
-                    request->process();
-                }
-                // TODO:这是干啥的
-                else
-                {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                request->process();
             }
-            // Reactor模式写IO事件
+            // 对端关闭或读出错，交给事件循环关闭连接
             else
             {
-                // 在子线程中执行write
-                if (request->write())
-                {
-                    request->improv = 1;
-                }
-                else
-                {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                request->notify(0);
             }
         }
-        // Proactor模式，主线程已经做好了IO,因此这里只需要解析请求
+        // Reactor模式写IO事件
         else
         {
-            // 拿到一个连接
-            connectionRAII mysql_conn(&request->m_mysql, m_connPool);
-            request->process();
+            // 在子线程中执行write，发送失败或短连接发送完毕都要关闭连接
+            if (!request->write())
+            {
+                request->notify(0);
+            }
         }
     }
+    // Proactor模式，主线程已经做好了IO,因此这里只需要解析请求
+    else
+    {
+        request->process();
+    }
 }
 #endif
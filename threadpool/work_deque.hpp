@@ -0,0 +1,66 @@
+#ifndef WORK_DEQUE_HPP
+#define WORK_DEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// 工作线程自己的有界任务队列，无锁
+// 只有所属的线程从底部push，所属线程和其他空闲线程都从顶部取(Chase-Lev的steal)，取的一方之间用CAS竞争
+// 所属线程也从顶部取，和Chase-Lev的LIFO不同，请求按先来先处理的顺序，不会有请求一直压在底下
+// 容量固定不扩容，满了由调用者放回别处
+template <typename T, int CAPACITY = 256>
+class work_deque
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY必须是2的幂");
+
+public:
+    work_deque() : m_top(0), m_bottom(0)
+    {
+        for (auto &slot : m_items)
+            slot.store(nullptr, std::memory_order_relaxed);
+    }
+
+    static constexpr int capacity() { return CAPACITY; }
+
+    // 所属线程调用，满了返回false
+    bool push(T *item)
+    {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY)
+            return false;
+        m_items[b & (CAPACITY - 1)].store(item, std::memory_order_relaxed);
+        m_bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 任何线程调用，取最早放入的，空的或者被别的线程抢先时返回空
+    T *steal()
+    {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        // 先读出再CAS，CAS失败说明这一格已经被别人取走，可能已经被push覆盖，读到的值作废
+        T *item = m_items[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    // 近似的任务数，其他线程可能正在修改
+    int size() const
+    {
+        int64_t n = m_bottom.load(std::memory_order_acquire) - m_top.load(std::memory_order_acquire);
+        return n > 0 ? (int)n : 0;
+    }
+
+private:
+    // 取的一方和push的一方分在不同的缓存行，减少伪共享
+    alignas(64) std::atomic<int64_t> m_top;
+    alignas(64) std::atomic<int64_t> m_bottom;
+    alignas(64) std::atomic<T *> m_items[CAPACITY];
+};
+
+#endif
@@ -1,182 +1,216 @@
 #include "timer.h"
 
-timer_list::~timer_list()
+Utils::~Utils()
 {
-    timer_node *tmp = head;
-    while (tmp)
-    {
-        head = tmp->next;
-        delete tmp;
-        tmp = head;
-    }
+    if (m_timerfd != -1)
+        close(m_timerfd);
 }
 
-// 添加定时器
-void timer_list::add_timer(timer_node *timer)
+time_wheel::time_wheel() : m_start_ms(get_cur_ms()), m_tick_ms(1000), m_cur_tick(0), m_size(0)
 {
-    if (!timer)
+    // 每个槽的哨兵自成一个空的循环链表
+    for (auto &slot : m_tv1)
     {
-        return;
+        slot.prev = slot.next = &slot;
     }
-    // 如果当前链表为空
-    if (!head)
+    for (auto &level : m_tvn)
     {
-        head = tail = timer;
-        return;
-    }
-    // 如果新的定时器超时时间小于当前头部结点，直接将新的定时器结点作为头部结点
-    if (timer->expire < head->expire)
-    {
-        timer->next = head;
-        head->prev = timer;
-        head = timer;
-        return;
+        for (auto &slot : level)
+        {
+            slot.prev = slot.next = &slot;
+        }
     }
-    // 否则调用私有成员函数add_timer查找合适的位置保证链表按照超时时间(expire)升序
-    add_timer(timer, head);
 }
 
-// 调整定时器，任务发生变化时，调整定时器在链表中的位置
-void timer_list::adjust_timer(timer_node *timer)
+// 节点不归时间轮所有(嵌在client_data中，可能已先于时间轮释放)，析构时不能再访问
+time_wheel::~time_wheel()
 {
-    if (!timer)
+}
+
+void time_wheel::init(int tick_ms)
+{
+    m_tick_ms = tick_ms > 0 ? tick_ms : 1;
+    m_start_ms = get_cur_ms();
+    m_cur_tick = 0;
+}
+
+uint64_t time_wheel::to_tick(int64_t expire) const
+{
+    if (expire <= m_start_ms)
     {
-        return;
+        return 0;
     }
+    return (uint64_t)((expire - m_start_ms + m_tick_ms - 1) / m_tick_ms);
+}
+
+// 距离到期不足256个时间片的放第0层，否则按距离放到能容纳它的最低一层
+// 超出最高层范围的先放在最高层最远的槽，下放时会按expire重新计算
+void time_wheel::link(timer_node *timer)
+{
+    uint64_t expires = to_tick(timer->expire);
+    timer_node *head;
 
-    // 被调整的定时器在链表尾部 or 定时器超时值仍然小于下一个定时器超时值，不调整
-    if (!timer->next || (timer->expire < timer->next->expire))
+    // 已经到期的放到下一个要处理的槽
+    if (expires < m_cur_tick)
     {
-        return;
+        head = &m_tv1[m_cur_tick & TVR_MASK];
     }
-
-    // 被调整定时器是链表头结点，将定时器取出，调用私有成员函数add_timer重新插入
-    if (timer == head)
+    else if (expires - m_cur_tick < (uint64_t)TVR_SIZE)
     {
-        head = head->next;
-        head->prev = nullptr;
-        timer->next = nullptr;
-        add_timer(timer, head);
+        head = &m_tv1[expires & TVR_MASK];
     }
-    // 被调整定时器在内部，将定时器取出，调用私有成员函数add_timer重新插入
     else
     {
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        add_timer(timer, timer->next);
+        uint64_t idx = expires - m_cur_tick;
+        int level = 0;
+        while (level < TVN_NUM - 1 && idx >= (1ULL << (TVR_BITS + (level + 1) * TVN_BITS)))
+        {
+            ++level;
+        }
+        uint64_t max_idx = (1ULL << (TVR_BITS + TVN_NUM * TVN_BITS)) - 1;
+        if (idx > max_idx)
+        {
+            expires = m_cur_tick + max_idx;
+        }
+        head = &m_tvn[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
     }
+
+    // 插到槽的尾部
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
 }
 
-// 删除定时器:即是双向链表节点的删除
-void timer_list::del_timer(timer_node *timer)
+void time_wheel::unlink(timer_node *timer)
 {
-    if (!timer)
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = nullptr;
+}
+
+int time_wheel::cascade(int level, int index)
+{
+    timer_node &slot = m_tvn[level][index];
+    timer_node *tmp = slot.next;
+    slot.prev = slot.next = &slot;
+    while (tmp != &slot)
     {
-        return;
+        timer_node *next = tmp->next;
+        link(tmp);
+        tmp = next;
     }
-    //链表中只有一个定时器，需要删除该定时器
-    if ((timer == head) && (timer == tail))
+    return index;
+}
+
+// 添加定时器
+void time_wheel::add_timer(timer_node *timer)
+{
+    if (!timer)
     {
-        delete timer;
-        head = nullptr;
-        tail = nullptr;
         return;
     }
+    ++m_size;
+    link(timer);
+}
 
-    //被删除的定时器为头结点
-    if (timer == head)
+// 调整定时器:摘下后按新的expire重新挂上
+void time_wheel::adjust_timer(timer_node *timer)
+{
+    if (!timer || !timer->linked())
     {
-        head = head->next;
-        head->prev = nullptr;
-        delete timer;
         return;
     }
+    unlink(timer);
+    link(timer);
+}
 
-    //被删除的定时器为尾结点
-    if (timer == tail)
+// 删除定时器
+void time_wheel::del_timer(timer_node *timer)
+{
+    if (!timer || !timer->linked())
     {
-        tail = tail->prev;
-        tail->next = nullptr;
-        delete timer;
         return;
     }
+    --m_size;
+    unlink(timer);
+}
 
-    //被删除的定时器在链表内部，常规链表结点删除
-    timer->prev->next = timer->next;
-    timer->next->prev = timer->prev;
-    delete timer;
+void time_wheel::tick()
+{
+    tick(get_cur_ms());
 }
 
-// 清理到期的链表节点，调用了cb_func()
-void timer_list::tick()
+// 逐个处理到now_ms为止的时间片，timerfd错过的到期在这里补上
+void time_wheel::tick(int64_t now_ms)
 {
-    if (!head)
+    if (now_ms < m_start_ms)
     {
         return;
     }
+    uint64_t target = (uint64_t)((now_ms - m_start_ms) / m_tick_ms);
 
-    // 获取当前时间
-    time_t cur = time(nullptr);
-
-    // 遍历定时器链表
-    timer_node *tmp = head;
-    while (tmp)
+    while (m_cur_tick <= target)
     {
-        // 链表容器为升序排列
-        // 当前时间小于头部定时器的超时时间，后面的定时器也没有到期，直接跳出
-        if (cur < tmp->expire)
+        int index = (int)(m_cur_tick & TVR_MASK);
+        // 第0层转完一圈，从上一层下放一个槽；上一层也转完一圈则继续往上
+        if (!index)
         {
-            break;
+            for (int level = 0; level < TVN_NUM; ++level)
+            {
+                if (cascade(level, (int)((m_cur_tick >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK)) != 0)
+                {
+                    break;
+                }
+            }
         }
+        ++m_cur_tick;
 
-        // 当前定时器到期，则调用回调函数，执行定时事件
-        tmp->cb_func(tmp->user_data);
-
-        // 将处理后的定时器从链表容器中删除，并重置头结点
-        head = tmp->next;
-        if (head)
+        // 先把整个槽摘下来再逐个回调
+        timer_node &slot = m_tv1[index];
+        if (slot.next == &slot)
         {
-            head->prev = nullptr;
+            continue;
         }
-        delete tmp;
-        tmp = head;
-    }
-}
+        timer_node expired;
+        expired.next = slot.next;
+        expired.prev = slot.prev;
+        expired.next->prev = &expired;
+        expired.prev->next = &expired;
+        slot.prev = slot.next = &slot;
 
-// 找到应该插入的地方
-// TODO:使用C++11的优先队列实现定时器
-void timer_list::add_timer(timer_node *timer, timer_node *lst_head)
-{
-    timer_node *prev = lst_head;
-    timer_node *tmp = prev->next;
-    // 遍历链表，找到合适的位置
-    while (tmp)
-    {
-        if (timer->expire < tmp->expire)
+        while (expired.next != &expired)
         {
-            prev->next = timer;
-            timer->next = tmp;
-            tmp->prev = timer;
-            timer->prev = prev;
-            break;
+            timer_node *tmp = expired.next;
+            unlink(tmp);
+            --m_size;
+            // 执行定时事件
+            tmp->cb_func(tmp->user_data);
         }
-        prev = tmp;
-        tmp = tmp->next;
     }
+}
 
-    //遍历完发现，目标定时器需要放到尾结点处
-    if (!tmp)
-    {
-        prev->next = timer;
-        timer->prev = prev;
-        timer->next = nullptr;
-        tail = timer;
-    }
+void Utils::init(int tick_ms)
+{
+    m_tick_ms = tick_ms;
+    m_timer_wheel.init(tick_ms);
 }
 
-void Utils::init(int timeslot)
+// 创建timerfd，第一次到期和之后的周期都是一个时间片
+// 定时器到期只是让fd可读，不会像SIGALRM那样打断其他线程的系统调用
+int Utils::create_timerfd()
 {
-    m_TIMESLOT = timeslot;
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(m_timerfd != -1);
+
+    struct itimerspec its;
+    memset(&its, '\0', sizeof(its));
+    its.it_interval.tv_sec = m_tick_ms / 1000;
+    its.it_interval.tv_nsec = (long)(m_tick_ms % 1000) * 1000000;
+    its.it_value = its.it_interval;
+    int ret = timerfd_settime(m_timerfd, 0, &its, nullptr);
+    assert(ret != -1);
+    return m_timerfd;
 }
 
 // 对文件描述符设置非阻塞
@@ -225,19 +259,6 @@ void Utils::modfd(int epollfd, int fd, int ev, int TRIGMode)
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-// 信号处理函数
-// 把当前信号值写到管道[1]端
-void Utils::sig_handler(int sig)
-{
-    // 为保证函数的可重入性，保留原来的errno
-    int save_errno = errno;
-    int msg = sig;
-    // 将信号值从管道写端写入，传输字符类型，而非整型
-    send(u_pipefd[1], (char *)&msg, 1, 0);
-    // 恢复原来的errno
-    errno = save_errno;
-}
-
 // 设置信号函数
 void Utils::addsig(int sig, void(handler)(int), bool restart)
 {
@@ -250,11 +271,13 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, nullptr) != -1);
 }
 
-// 定时处理任务，重新定时以不断触发SIGALRM信号
+// 定时处理任务
+// 先读出到期次数使timerfd不再可读，错过的多次到期只需要tick一次
 void Utils::timer_handler()
 {
-    m_timer_lst.tick();
-    alarm(m_TIMESLOT); // 重新触发SIGALRM信号
+    uint64_t expirations;
+    ::read(m_timerfd, &expirations, sizeof(expirations));
+    m_timer_wheel.tick();
 }
 
 // 向连接客户发送错误报告
@@ -264,20 +287,23 @@ void Utils::show_error(int connfd, const char *info)
     close(connfd);
 }
 
-// static变量类内定义类外初始化
-int *Utils::u_pipefd = nullptr;
-int Utils::u_epollfd = 0;
-
-class Utils;
+int64_t get_cur_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
 // 定时器回调函数:从内核事件表删除事件，关闭文件描述符，释放连接资源
 void cb_func(client_data *user_data)
 {
-    // 删除非活动连接在socket上的注册事件
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->client_sockfd, nullptr);
     assert(user_data);
+    // 删除非活动连接在socket上的注册事件，连接注册在哪个epoll上就从哪个删除
+    epoll_ctl(user_data->client_epollfd, EPOLL_CTL_DEL, user_data->client_sockfd, nullptr);
     // 删除非活动连接在socket上的注册事件
     close(user_data->client_sockfd);
     // 减少连接数
     http_conn::m_user_count--;
+    if (user_data->client_load)
+        (*user_data->client_load)--;
 }
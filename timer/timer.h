@@ -2,6 +2,7 @@
 #define TIMER_H
 
 #include <unistd.h>
+#include <atomic>
 #include <csignal>
 #include <sys/types.h>
 #include <sys/epoll.h>
@@ -21,75 +22,121 @@
 #include <sys/wait.h>
 #include <sys/uio.h>
 #include <ctime>
+#include <cstdint>
+#include <sys/timerfd.h>
 
 #include "../http/http_conn.h"
 #include "../log/log.h"
 
-// 连接资源结构体成员需要用到定时器类
+// 定时器回调需要用到连接资源结构体
 // 需要前向声明
-class timer_node;
-
-// 客户端数据
-struct client_data
-{
-    sockaddr_in clinet_address; // 客户端socket地址
-    int client_sockfd;          // socket文件描述符
-    timer_node *client_timer;   // 定时器
-};
+struct client_data;
+class time_wheel;
 
 // 将连接资源、定时事件和超时时间封装为类，并以双向链表的形式组织起来
+// 在时间轮中prev/next串起同一个槽内的定时器，不在任何槽上时prev/next为空
 class timer_node
 {
 public:
     timer_node() : prev(nullptr), next(nullptr) {}
 
+    // 是否挂在时间轮上
+    bool linked() const { return prev != nullptr; }
+
 public:
-    time_t expire;                  // 超时时间，绝对时间
+    int64_t expire;                 // 超时时间，单调时钟的绝对毫秒数
     void (*cb_func)(client_data *); // 回调函数:从内核事件表删除事件，关闭文件描述符，释放连接资源
     client_data *user_data;         // 连接资源
     timer_node *prev;               // 前向指针
     timer_node *next;               // 后继指针
 };
 
-// 定时器链表类
-// 为每个连接创建一个定时器，将其添加到链表中，并按照超时时间升序排列。执行定时任务时，将到期的定时器从链表中删除
-// 添加定时器的事件复杂度是O(n),删除定时器的事件复杂度是O(1)
-class timer_list
+// 客户端数据
+// m_client_datas按fd预分配，定时器节点直接嵌在其中，建立和关闭连接都不需要new/delete
+struct client_data
+{
+    sockaddr_in clinet_address;     // 客户端socket地址
+    int client_sockfd;              // socket文件描述符
+    int client_epollfd;             // 连接所属的epoll(主reactor或某个从reactor)
+    timer_node *client_timer;       // 定时器，指向client_timer_node，没有定时器时为空
+    time_wheel *client_timer_wheel; // 定时器所在的时间轮，每个reactor各有一个
+    std::atomic<int> *client_load;  // 所属从reactor的连接数，关闭时减一，单reactor时为空
+    timer_node client_timer_node;   // 该fd的定时器节点
+};
+
+// 分层时间轮，参考Linux内核的定时器实现
+// 第0层256个槽，每个槽一个时间片；第1~3层各64个槽，每个槽是下一层转一圈的时间
+// 定时器按到期的时间片挂到对应层的槽上，槽是带哨兵的双向循环链表，添加、调整、删除都是O(1)
+// tick时整槽处理到期的定时器，第0层转完一圈就把上一层的一个槽下放到低层
+// 时间轮不拥有定时器节点，节点嵌在client_data中，删除和到期只是从槽上摘下
+class time_wheel
 {
 public:
-    timer_list() : head(nullptr), tail(nullptr) {}
-    ~timer_list();
+    time_wheel();
+    ~time_wheel();
+
+    // 设置时间片(毫秒)，需在添加定时器之前调用
+    void init(int tick_ms);
 
-    // 添加定时器，内部调用私有成员add_timer
+    // 添加定时器
     void add_timer(timer_node *timer);
 
-    // 调整定时器，任务发生变化时，调整定时器在链表中的位置
+    // 调整定时器，expire改变后移到新的槽
     void adjust_timer(timer_node *timer);
 
-    // 删除定时器
+    // 删除定时器，已经到期摘下的定时器直接忽略
     void del_timer(timer_node *timer);
 
-    // SIGALARM信号每次被触发就在信号处理函数中执行一次tick()
-    // 该函数清理链表上的到期的节点
+    // 按当前时间处理到期的定时器
     void tick();
 
-private:
-    // 被add_timer调用，把一个节点按照超市顺序插入
-    void add_timer(timer_node *timer, timer_node *lst_head);
+    // 处理now_ms(单调时钟毫秒数)之前到期的全部定时器
+    void tick(int64_t now_ms);
+
+    // 时间轮中定时器的个数，即该时间轮管理的连接数
+    int size() const { return m_size; }
 
-    //头尾结点
-    timer_node *head;
-    timer_node *tail;
+private:
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int TVR_MASK = TVR_SIZE - 1;
+    static const int TVN_MASK = TVN_SIZE - 1;
+    static const int TVN_NUM = 3; // 第0层之上的层数
+
+    // 把expire换算成从m_start_ms起的时间片序号，向上取整保证不会提前到期
+    uint64_t to_tick(int64_t expire) const;
+
+    // 按到期时间片把定时器挂到对应的槽
+    void link(timer_node *timer);
+
+    // 从所在的槽上摘下
+    static void unlink(timer_node *timer);
+
+    // 把第level层的第index个槽重新分配到低层，返回index
+    int cascade(int level, int index);
+
+    timer_node m_tv1[TVR_SIZE];           // 第0层
+    timer_node m_tvn[TVN_NUM][TVN_SIZE];  // 第1~3层
+    int64_t m_start_ms;                   // 时间轮的起点
+    int m_tick_ms;                        // 时间片(毫秒)
+    uint64_t m_cur_tick;                  // 下一个要处理的时间片
+    int m_size;
 };
 
 // 通用的工具类
 class Utils
 {
 public:
-    Utils(){};
-    ~Utils(){};
+    Utils() : m_timerfd(-1), m_tick_ms(0){};
+    ~Utils();
+
+    // tick_ms为定时器的时间片(毫秒)
+    void init(int tick_ms);
 
-    void init(int timeslot);
+    // 创建按时间片周期到期的timerfd，由事件循环注册到epoll或io_uring
+    int create_timerfd();
 
     // 对文件描述符设置非阻塞
     int setnonblocking(int fd);
@@ -103,24 +150,23 @@ public:
     // 将事件重置为EPOLLONESHOT
     void modfd(int epollfd, int fd, int ev, int TRIGMode);
 
-    // 信号处理函数
-    static void sig_handler(int sig);
-
     // 设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    // 定时处理任务，重新定时以不断触发SIGALRM信号
+    // 定时处理任务，读出timerfd的到期次数并清理到期的连接
     void timer_handler();
 
     void show_error(int connfd, const char *info);
 
 public:
-    static int *u_pipefd;
-    static int u_epollfd;
-    timer_list m_timer_lst;
-    int m_TIMESLOT; // 定时器的时间片
+    time_wheel m_timer_wheel;
+    int m_timerfd;  // 驱动时间轮的timerfd
+    int m_tick_ms;  // 定时器的时间片(毫秒)
 };
 
+// 单调时钟的当前毫秒数，不受系统时间调整影响
+int64_t get_cur_ms();
+
 // 定时器回调函数
 void cb_func(client_data *user_data);
 
@@ -8,18 +8,27 @@ WebServer::WebServer()
 
     // 保存全部定时器
     m_client_datas = new client_data[MAX_FD];
+
+    m_reactors = nullptr;
+    m_uring = nullptr;
+    m_thread_pool = nullptr;
+    m_signalfd = -1;
 }
 
 // 服务器资源释放
 WebServer::~WebServer()
 {
+    // 先停掉工作线程，它们会向各个事件循环的完成队列交回连接
+    delete m_thread_pool;
+    LOG_INFO("file cache hits:%ld misses:%ld", file_cache::get_instance()->hits(), file_cache::get_instance()->misses());
+    // 再停掉从reactor线程，它们还在访问连接数组
+    delete[] m_reactors;
+    delete m_uring;
     close(m_epollfd);
     close(m_listenfd);
-    close(m_pipefd[1]);
-    close(m_pipefd[0]);
+    close(m_signalfd);
     delete[] m_http_conns;
     delete[] m_client_datas;
-    delete m_thread_pool;
 }
 
 // 初始化用户名、数据库等信息
@@ -33,10 +42,43 @@ void WebServer::init(const string &user, const string &passWord, const string &D
     m_port = config.m_port;
     m_sql_num = config.m_sql_num;
     m_thread_num = config.m_thread_num;
+    m_max_thread_num = config.m_max_thread_num;
+    m_db_thread_num = config.m_db_thread_num;
     m_log_mode = config.m_log_mode;
     m_linger = config.m_linger;
     m_close_log = config.m_close_log;
     m_actormodel = config.m_actor_mode;
+    m_tick_ms = config.m_tick_ms > 0 ? config.m_tick_ms : 1000;
+    m_cache_mb = config.m_cache_mb > 0 ? config.m_cache_mb : 0;
+    m_compress_dir = config.m_compress ? rootPath + "_compressed" : "";
+    m_reactor_num = config.m_reactor_num;
+    m_dispatch_mode = config.m_dispatch_mode;
+    m_next_reactor = 0;
+    // 分片数即从reactor数，每个分片一个线程
+    m_listen_shards = config.m_listen_shards;
+    if (m_listen_shards > 0)
+    {
+        m_reactor_num = m_listen_shards;
+    }
+
+    // io_uring模式:主线程用io_uring收发，工作线程只解析，相当于Proactor，不支持多reactor
+    m_io_mode = config.m_io_mode;
+    if (1 == m_io_mode)
+    {
+        m_actormodel = 0;
+        m_reactor_num = 0;
+        m_listen_shards = 0;
+    }
+
+    // 静态文件发送方式，io_uring模式的发送由writev请求完成，只支持mmap
+    http_conn::m_send_mode = (1 == m_io_mode) ? 0 : config.m_send_mode;
+    http_conn::m_autoindex = config.m_autoindex;
+
+    // 静态文件响应的Cache-Control
+    if (0 == config.m_max_age)
+        snprintf(http_conn::m_cache_control, sizeof(http_conn::m_cache_control), "no-cache");
+    else if (config.m_max_age > 0)
+        snprintf(http_conn::m_cache_control, sizeof(http_conn::m_cache_control), "max-age=%d", config.m_max_age);
 
     // 配置触发模式
     m_trigger_mode = config.m_trigger_mode;
@@ -60,6 +102,13 @@ void WebServer::init(const string &user, const string &passWord, const string &D
         m_listen_trigger_mode = 1;
         m_conn_trigger_mode = 1;
     }
+
+    // 在创建任何线程(日志、线程池、从reactor)之前屏蔽SIGTERM和SIGINT
+    // 新线程继承屏蔽字，信号不会打断任何线程，只能由主线程通过signalfd读出
+    sigemptyset(&m_sigmask);
+    sigaddset(&m_sigmask, SIGTERM);
+    sigaddset(&m_sigmask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &m_sigmask, nullptr);
 }
 
 // 单例模式获取一个日志的实例
@@ -90,15 +139,17 @@ void WebServer::sql_pool()
 void WebServer::thread_pool()
 {
     // 线程池,线程池的任务是http_conn
-    m_thread_pool = new threadpool<http_conn>(m_actormodel, m_sql_pool, m_thread_num);
+    m_thread_pool = new threadpool<http_conn>(m_actormodel, m_thread_num, m_max_thread_num, m_db_thread_num);
+    http_conn::m_thread_pool = m_thread_pool;
 }
 
-// 设置监听socket，epoll和定时器
-void WebServer::eventListen()
+// 创建监听socket并bind到m_port
+// reuse_port为true时开启SO_REUSEPORT，多个socket可以绑定同一端口，由内核把新连接分散到各个socket
+int WebServer::create_listenfd(bool reuse_port)
 {
     // 网络编程基础步骤
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    assert(listenfd >= 0);
 
     // 优雅关闭连接
     // 游双5.11.4 linger结构体第一个参数控制开关,第二个参数控制时间
@@ -106,14 +157,14 @@ void WebServer::eventListen()
     if (0 == m_linger)
     {
         struct linger tmp = {0, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
     // 非阻塞的socket:调用close立即返回
     // 阻塞的socket:  等待指定的时间后，直到残留数据发送完成且收到确认；否则close返回-1且errno为EWOUDLDBLOCK
     else if (1 == m_linger)
     {
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     // 配置地址
@@ -125,16 +176,41 @@ void WebServer::eventListen()
 
     int reuse = 1;
     // SO_REUSEADDR:处在TIME_WAIT状态的连接可以被强制使用
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // SO_REUSEPORT:每个绑定同一端口的socket有独立的accept队列
+    if (reuse_port)
+    {
+        int ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+        assert(ret != -1);
+    }
 
-    int bind_ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+    int bind_ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(bind_ret >= 0);
 
-    int listen_ret = listen(m_listenfd, 5);
+    int listen_ret = listen(listenfd, 5);
     assert(listen_ret >= 0);
 
+    return listenfd;
+}
+
+// 设置监听socket，epoll和定时器
+void WebServer::eventListen()
+{
+    // SO_REUSEPORT分片模式下主线程不监听，每个从reactor有自己的监听socket
+    m_listenfd = -1;
+    if (m_listen_shards <= 0)
+    {
+        m_listenfd = create_listenfd(false);
+    }
+
+    // 静态文件缓存，监听资源目录的修改
+    file_cache::get_instance()->init(m_root, (size_t)m_cache_mb << 20, m_close_log);
+
+    // 预压缩文件，可压缩的文件由后台线程压缩到m_compress_dir
+    compressor::get_instance()->init(m_root, m_compress_dir.c_str(), m_close_log);
+
     // 初始化定时器的时间片
-    m_utils.init(TIMESLOT);
+    m_utils.init(m_tick_ms);
 
     // 配置epoll
     epoll_event events[MAX_EVENT_NUMBER]; // e存储epoll就绪事件
@@ -143,64 +219,89 @@ void WebServer::eventListen()
 
     // 设置listenfd为不开启oneshot以及触发模式
     // 调用了epoll_ctl
-    m_utils.addfd(m_epollfd, m_listenfd, false, m_listen_trigger_mode);
-
-    // http_conn中的epollfd是一个static全局变量
-    http_conn::m_epollfd = m_epollfd;
+    // io_uring模式不注册epoll，监听socket和管道读端保持阻塞
+    if (m_listenfd != -1 && 1 != m_io_mode)
+    {
+        m_utils.addfd(m_epollfd, m_listenfd, false, m_listen_trigger_mode);
+    }
 
-    // 创建管道，管道写端[1]写入信号值，管道读端[0]通过I/O复用系统监测读事件
-    // socketpair相当于两端可读可写的pipe
-    int socketpair_ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
-    assert(socketpair_ret != -1);
+    // 定时器和退出信号都变成可读的fd，和socket一起由事件循环处理，不再需要信号处理函数
+    // timerfd每个时间片到期一次，驱动时间轮
+    m_utils.create_timerfd();
 
-    // 管道写端非阻塞
-    m_utils.setnonblocking(m_pipefd[1]);
+    // signalfd读出init()中屏蔽的SIGTERM（kill会触发）和SIGINT（Ctrl+C）
+    m_signalfd = signalfd(-1, &m_sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert(m_signalfd != -1);
 
-    // 管道读端为ET+非阻塞并用epoll监听
-    m_utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    if (1 != m_io_mode)
+    {
+        m_utils.addfd(m_epollfd, m_utils.m_timerfd, false, 0);
+        m_utils.addfd(m_epollfd, m_signalfd, false, 0);
+        m_utils.addfd(m_epollfd, m_completions.get_fd(), false, 0);
+    }
 
-    // 设置信号处理函数SIGALRM（时间到了触发）和SIGTERM（kill会触发，Ctrl+C）
+    // 对端关闭后继续写会触发SIGPIPE，忽略它
     m_utils.addsig(SIGPIPE, SIG_IGN);
-    m_utils.addsig(SIGALRM, Utils::sig_handler, false);
-    m_utils.addsig(SIGTERM, Utils::sig_handler, false);
 
-    // 每隔TIMESLOT(5s)触发SIGALRM信号
-    alarm(TIMESLOT);
+    if (1 == m_io_mode)
+    {
+        m_uring = new uring_loop;
+        m_uring->init(this, m_listenfd, m_utils.m_timerfd, m_signalfd, m_close_log);
+    }
 
-    // 这两个是static变量
-    Utils::u_pipefd = m_pipefd;
-    Utils::u_epollfd = m_epollfd;
+    // 多reactor模式:主reactor只负责accept，每个从reactor一个线程，各自有epoll和时间轮
+    // 分片模式:每个从reactor再绑定一个SO_REUSEPORT的监听socket，自己accept自己处理，不经过主reactor
+    if (m_reactor_num > 0)
+    {
+        m_reactors = new sub_reactor[m_reactor_num];
+        for (int i = 0; i < m_reactor_num; ++i)
+        {
+            m_reactors[i].init(this, i, m_tick_ms, m_close_log);
+            if (m_listen_shards > 0)
+            {
+                m_reactors[i].listen_on(create_listenfd(true), m_listen_trigger_mode);
+            }
+            m_reactors[i].start();
+        }
+    }
 }
 
 /************************** 定时器相关的函数 **************************/
 
 // 初始化定时器
-void WebServer::init_timer(int connfd, struct sockaddr_in client_address)
+// 单reactor时epollfd和timer_wheel是主线程的，多reactor时是负责该连接的从reactor的
+// io_uring模式epollfd为-1，处理结果通过completions交回事件循环
+void WebServer::init_timer(int connfd, struct sockaddr_in client_address, int epollfd, time_wheel &timer_wheel,
+                           completion_queue<http_conn> *completions, std::atomic<int> *load)
 {
     // 将connfd注册到内核事件表
-    m_http_conns[connfd].init(connfd, client_address, m_root, m_conn_trigger_mode, m_close_log, m_DB_user, m_DB_password, m_DB_name);
+    m_http_conns[connfd].init(connfd, client_address, epollfd, completions, m_root, m_conn_trigger_mode, m_close_log, m_DB_user, m_DB_password, m_DB_name);
 
-    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
+    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到时间轮中
     m_client_datas[connfd].clinet_address = client_address;
     m_client_datas[connfd].client_sockfd = connfd;
-    auto *timer = new timer_node;
+    m_client_datas[connfd].client_epollfd = epollfd;
+    m_client_datas[connfd].client_timer_wheel = &timer_wheel;
+    m_client_datas[connfd].client_load = load;
+    // 定时器节点嵌在该fd的client_data中，不需要分配
+    timer_node *timer = &m_client_datas[connfd].client_timer_node;
     timer->user_data = &m_client_datas[connfd];
     timer->cb_func = cb_func;
-    time_t cur = time(nullptr);
+    int64_t cur = get_cur_ms();
 
     // TIMESLOT:最小时间间隔单位为5s
-    timer->expire = cur + 3 * TIMESLOT; // 15s定时
+    timer->expire = cur + 3 * TIMESLOT * 1000; // 15s定时
     m_client_datas[connfd].client_timer = timer;
-    m_utils.m_timer_lst.add_timer(timer);
+    timer_wheel.add_timer(timer);
 }
 
 // 若有数据传输，则将定时器往后延迟3个单位
-// 并对新的定时器在链表上的位置进行调整
+// 并把定时器移到时间轮上新的槽
 void WebServer::adjust_timer(timer_node *timer)
 {
-    time_t cur = time(nullptr);
-    timer->expire = cur + 3 * TIMESLOT;
-    m_utils.m_timer_lst.adjust_timer(timer);
+    int64_t cur = get_cur_ms();
+    timer->expire = cur + 3 * TIMESLOT * 1000;
+    timer->user_data->client_timer_wheel->adjust_timer(timer);
 
     LOG_INFO("%s", "adjust client_timer once");
 }
@@ -208,19 +309,60 @@ void WebServer::adjust_timer(timer_node *timer)
 // 关闭定时器
 void WebServer::deal_timer(timer_node *timer, int sockfd)
 {
-    timer->cb_func(&m_client_datas[sockfd]);
+    // 定时器节点属于这个fd，cb_func关闭fd后该fd可能立刻被其他reactor复用并重新挂上节点
+    // 所以先从时间轮上摘下，再执行回调
     if (timer)
     {
-        m_utils.m_timer_lst.del_timer(timer);
+        m_client_datas[sockfd].client_timer_wheel->del_timer(timer);
     }
-    LOG_INFO("close fd %d", m_client_datas[sockfd].client_sockfd);
+    timer->cb_func(&m_client_datas[sockfd]);
+    LOG_INFO("close fd %d", sockfd);
 }
 /************************** 定时器相关的函数 **************************/
 
+// 把新连接交给主reactor自己或某个从reactor
+// acceptor非空表示连接是分片模式下从reactor自己accept的，直接留在该reactor
+void WebServer::dispatch_conn(int connfd, struct sockaddr_in client_address, sub_reactor *acceptor)
+{
+    if (acceptor)
+    {
+        acceptor->m_load++;
+        init_timer(connfd, client_address, acceptor->m_epollfd, acceptor->m_utils.m_timer_wheel,
+                   1 == m_actormodel ? &acceptor->m_completions : nullptr, &acceptor->m_load);
+        return;
+    }
+
+    if (m_reactor_num <= 0)
+    {
+        init_timer(connfd, client_address, m_epollfd, m_utils.m_timer_wheel,
+                   1 == m_actormodel ? &m_completions : nullptr);
+        return;
+    }
+
+    int idx = 0;
+    // 最小负载:选当前连接数最少的从reactor
+    if (1 == m_dispatch_mode)
+    {
+        for (int i = 1; i < m_reactor_num; ++i)
+        {
+            if (m_reactors[i].load() < m_reactors[idx].load())
+                idx = i;
+        }
+    }
+    // 轮询(默认)
+    else
+    {
+        idx = m_next_reactor;
+        m_next_reactor = (m_next_reactor + 1) % m_reactor_num;
+    }
+    m_reactors[idx].add_conn(connfd, client_address);
+}
+
 // 处理用户连接
 // 执行了accept得到一个connfd
 // 分配了定时器
-bool WebServer::deal_client()
+// listenfd是主reactor的m_listenfd，或分片模式下acceptor自己的监听socket
+bool WebServer::deal_client(int listenfd, sub_reactor *acceptor)
 {
     struct sockaddr_in client_address
     {
@@ -230,7 +372,7 @@ bool WebServer::deal_client()
     // 监听socket为LT模式(默认)，不需要一次就处理
     if (0 == m_listen_trigger_mode)
     {
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addr_length);
+        int connfd = accept(listenfd, (struct sockaddr *)&client_address, &client_addr_length);
         if (connfd < 0)
         {
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
@@ -242,7 +384,7 @@ bool WebServer::deal_client()
             LOG_ERROR("%s", "Internal server busy");
             return false;
         }
-        init_timer(connfd, client_address);
+        dispatch_conn(connfd, client_address, acceptor);
     }
     // 监听socket为ET模式，需要一次性处理数据(死循环)
     else
@@ -252,7 +394,7 @@ bool WebServer::deal_client()
         while (true)
         {
             // accept返回了一个新的connfd用于send()和recv()
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addr_length);
+            int connfd = accept(listenfd, (struct sockaddr *)&client_address, &client_addr_length);
             if (connfd < 0)
             {
                 LOG_ERROR("%s:errno is:%d", "accept error", errno);
@@ -264,43 +406,29 @@ bool WebServer::deal_client()
                 LOG_ERROR("%s", "Internal server busy");
                 break;
             }
-            init_timer(connfd, client_address);
+            dispatch_conn(connfd, client_address, acceptor);
         }
         return false;
     }
     return true;
 }
 
-// 处理定时器信号
-bool WebServer::deal_signal(bool &timeout, bool &stop_server)
+// 处理退出信号
+bool WebServer::deal_signal(bool &stop_server)
 {
-    int ret = 0;
-    int sig;
-    char signals[1024];
-    // 从管道读端读出信号值，成功返回字节数，失败返回-1
-    ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
-    if (ret == -1 || ret == 0)
+    // signalfd每次读出若干个完整的signalfd_siginfo
+    struct signalfd_siginfo infos[16];
+    ssize_t ret = read(m_signalfd, infos, sizeof(infos));
+    if (ret <= 0)
     {
         return false;
     }
-    // 正常情况下，这里的ret返回值总是1，只有14和15两个ASCII码对应的字符
-    else
+    for (size_t i = 0; i < ret / sizeof(signalfd_siginfo); ++i)
     {
-        for (int i = 0; i < ret; ++i)
+        if (SIGTERM == infos[i].ssi_signo || SIGINT == infos[i].ssi_signo)
         {
-            switch (signals[i])
-            {
-            case SIGALRM:
-            {
-                timeout = true;
-                break;
-            }
-            case SIGTERM:
-            {
-                stop_server = true;
-                break;
-            }
-            }
+            LOG_INFO("receive signal %d, stop server", infos[i].ssi_signo);
+            stop_server = true;
         }
     }
     return true;
@@ -313,32 +441,17 @@ void WebServer::deal_read(int sockfd)
     timer_node *timer = m_client_datas[sockfd].client_timer;
 
     // reactor
-    // 只负责把请求放到队列中去
+    // 只负责把请求放到队列中去，不等待工作线程，处理结果由deal_completions接收
     if (1 == m_actormodel)
     {
-        // 调整定时器
+        // 工作线程持有连接期间定时器从时间轮上摘下，避免超时关闭正在处理的连接
         if (timer)
         {
-            adjust_timer(timer); // 将定时器往后延迟15s
+            m_client_datas[sockfd].client_timer_wheel->del_timer(timer);
         }
 
         // 监测到读事件，将该事件放入请求队列，标记为读事件0
         m_thread_pool->append(m_http_conns + sockfd, 0);
-
-        // TODO:这个while循环把timer_flag和improv改为0
-        while (true)
-        {
-            if (1 == m_http_conns[sockfd].improv)
-            {
-                if (1 == m_http_conns[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    m_http_conns[sockfd].timer_flag = 0;
-                }
-                m_http_conns[sockfd].improv = 0;
-                break;
-            }
-        }
     }
     // proactor(默认)，主线程循环读取客户数据
     else
@@ -371,25 +484,10 @@ void WebServer::deal_write(int sockfd)
     {
         if (timer)
         {
-            adjust_timer(timer);
+            m_client_datas[sockfd].client_timer_wheel->del_timer(timer);
         }
         // 添加到线程池中，标记事件为写1
         m_thread_pool->append(m_http_conns + sockfd, 1);
-
-        // TODO:同没搞懂这些定时器的操作在干嘛
-        while (true)
-        {
-            if (1 == m_http_conns[sockfd].improv)
-            {
-                if (1 == m_http_conns[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    m_http_conns[sockfd].timer_flag = 0;
-                }
-                m_http_conns[sockfd].improv = 0;
-                break;
-            }
-        }
     }
     // proactor
     else
@@ -398,6 +496,11 @@ void WebServer::deal_write(int sockfd)
         if (m_http_conns[sockfd].write())
         {
             LOG_INFO("send data to the client(%s)", inet_ntoa(m_http_conns[sockfd].get_address()->sin_addr));
+            // 读缓冲区里还有流水线请求，write()没有重新注册事件，交给工作线程接着解析
+            if (m_http_conns[sockfd].has_request())
+            {
+                m_thread_pool->append_p(m_http_conns + sockfd);
+            }
             if (timer)
             {
                 adjust_timer(timer);
@@ -410,9 +513,44 @@ void WebServer::deal_write(int sockfd)
     }
 }
 
+// 处理工作线程交回的连接
+// 连接交给工作线程后oneshot事件和定时器都已摘下，这里是唯一能再操作该连接的地方，不会和超时关闭冲突
+void WebServer::deal_completions(completion_queue<http_conn> &completions, std::vector<std::pair<http_conn *, int>> &done)
+{
+    // 先清空eventfd计数再取队列，保证不会漏掉通知
+    uint64_t cnt;
+    ::read(completions.get_fd(), &cnt, sizeof(cnt));
+
+    completions.drain(done);
+    for (auto &item : done)
+    {
+        int sockfd = item.first->m_sockfd;
+        client_data *user_data = &m_client_datas[sockfd];
+        // 读写失败或短连接已发送完毕
+        if (0 == item.second)
+        {
+            user_data->client_timer->cb_func(user_data);
+            LOG_INFO("close fd %d", sockfd);
+            continue;
+        }
+        // 重新挂上定时器，重置oneshot事件
+        timer_node *timer = user_data->client_timer;
+        timer->expire = get_cur_ms() + 3 * TIMESLOT * 1000;
+        user_data->client_timer_wheel->add_timer(timer);
+        m_utils.modfd(item.first->m_epollfd, sockfd, item.second, m_conn_trigger_mode);
+    }
+}
+
 // 事件回环(即服务器主线程)
 void WebServer::eventLoop()
 {
+    // io_uring模式使用自己的事件回环
+    if (m_uring)
+    {
+        m_uring->run();
+        return;
+    }
+
     bool timeout_flag = false;
     bool stop_server = false;
 
@@ -433,7 +571,7 @@ void WebServer::eventLoop()
             // 处理用户连接
             if (sockfd == m_listenfd)
             {
-                deal_client();
+                deal_client(m_listenfd);
             }
             // 处理定时和异常事件
             else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
@@ -441,11 +579,20 @@ void WebServer::eventLoop()
                 timer_node *timer = m_client_datas[sockfd].client_timer;
                 deal_timer(timer, sockfd);
             }
-            // 处理定时器信号 有数据进来，且是在管道[0]的数据
-            else if ((sockfd == m_pipefd[0]) && (m_events[i].events & EPOLLIN))
+            // timerfd到期，本轮读写处理完后再tick
+            else if (sockfd == m_utils.m_timerfd)
+            {
+                timeout_flag = true;
+            }
+            // 收到SIGTERM或SIGINT
+            else if (sockfd == m_signalfd)
+            {
+                deal_signal(stop_server);
+            }
+            // Reactor模式下工作线程处理完了一批连接
+            else if (sockfd == m_completions.get_fd())
             {
-                // 判断信号，并修改参数
-                deal_signal(timeout_flag, stop_server);
+                deal_completions(m_completions, m_done);
             }
             // 处理读操作
             else if (m_events[i].events & EPOLLIN)
@@ -458,7 +605,7 @@ void WebServer::eventLoop()
                 deal_write(sockfd);
             }
         }
-        // 处理定时器为非必须事件，收到信号并不是立马处理，完成读写事件后，再进行处理
+        // 处理定时器为非必须事件，timerfd可读并不是立马处理，完成读写事件后，再进行处理
         if (timeout_flag)
         {
             m_utils.timer_handler();
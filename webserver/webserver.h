@@ -11,16 +11,20 @@
 #include <cstdlib>
 #include <cassert>
 #include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <csignal>
 
 #include "../threadpool/threadpool.hpp"
 #include "../connpool/conn_pool.h"
 #include "../http/http_conn.h"
 #include "../config/config.hpp"
 #include "../timer/timer.h"
+#include "../reactor/sub_reactor.h"
+#include "../reactor/uring_loop.h"
 
 const int MAX_FD = 65536;           // 最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; // 最大事件数
-const int TIMESLOT = 5;             // 最小超时单位
+const int TIMESLOT = 5;             // 最小超时单位(秒)，空闲连接3个单位后关闭
 
 class WebServer
 {
@@ -36,20 +40,28 @@ public:
     void sql_pool();
     // 单例模式获取一个日志的实例
     void log_write();
+    // 创建监听socket，reuse_port为true时开启SO_REUSEPORT
+    int create_listenfd(bool reuse_port);
     // 设置监听socket，epoll和定时器
     void eventListen();
     // 事件回环(即服务器主线程)
     void eventLoop();
-    // 初始化定时器
-    void init_timer(int connfd, struct sockaddr_in client_address);
+    // 初始化定时器，连接注册到epollfd上，定时器加入timer_wheel
+    // load为负责该连接的从reactor的连接数，已在分发时加一，连接关闭时由cb_func减一
+    void init_timer(int connfd, struct sockaddr_in client_address, int epollfd, time_wheel &timer_wheel,
+                    completion_queue<http_conn> *completions = nullptr, std::atomic<int> *load = nullptr);
     void adjust_timer(timer_node *timer);
+    // 把新连接交给主reactor自己或某个从reactor
+    void dispatch_conn(int connfd, struct sockaddr_in client_address, sub_reactor *acceptor = nullptr);
 
     // 事件回环的五个逻辑
     void deal_timer(timer_node *timer, int sockfd);
-    bool deal_client();
-    bool deal_signal(bool &timeout, bool &stop_server);
+    bool deal_client(int listenfd, sub_reactor *acceptor = nullptr);
+    bool deal_signal(bool &stop_server);
     void deal_read(int sockfd);
     void deal_write(int sockfd);
+    // Reactor模式下处理工作线程交回的连接，每个事件循环处理自己的完成队列
+    void deal_completions(completion_queue<http_conn> &completions, std::vector<std::pair<http_conn *, int>> &done);
 
 public:
     int m_port;   // 端口号,默认9006
@@ -61,10 +73,27 @@ public:
 
     // 并发模型
     int m_actormodel;                       // 并发模型,默认是proactor
-    int m_pipefd[2];                        // 信号传输管道
+    int m_signalfd;                         // 读取SIGTERM/SIGINT的signalfd
+    sigset_t m_sigmask;                     // 由signalfd接收的信号集合
+    int m_tick_ms;                          // 定时器时间片(毫秒)
+    int m_cache_mb;                         // 静态文件缓存大小(MB)
+    string m_compress_dir;                  // 后台压缩的文件目录，为空时不在后台压缩
     int m_epollfd;                          // epoll文件描述符
     http_conn *m_http_conns;                // 保存全部连接
     epoll_event m_events[MAX_EVENT_NUMBER]; // epoll事件数组
+    completion_queue<http_conn> m_completions;        // Reactor模式下工作线程交回连接的队列
+    std::vector<std::pair<http_conn *, int>> m_done;  // drain出来的完成项
+
+    // 多reactor相关
+    int m_reactor_num;       // 从reactor数量，0表示主线程处理全部连接
+    int m_dispatch_mode;     // 新连接分发策略:0轮询,1最小负载
+    int m_next_reactor;      // 轮询分发的下一个从reactor
+    sub_reactor *m_reactors; // 从reactor数组
+    int m_listen_shards;     // SO_REUSEPORT监听分片数，大于0时每个从reactor自己accept
+
+    // io_uring相关
+    int m_io_mode;       // IO引擎:0为epoll，1为io_uring
+    uring_loop *m_uring; // io_uring事件循环
 
     // 数据库相关
     connection_pool *m_sql_pool; // 数据库实例
@@ -76,6 +105,8 @@ public:
     // 线程池相关
     threadpool<http_conn> *m_thread_pool; // 线程池实例
     int m_thread_num;                     // 线程池内的线程数量,默认8
+    int m_max_thread_num;                 // 线程池最多的线程数量,默认32
+    int m_db_thread_num;                  // 线程池数据库通道的线程数量,默认4
 
     // 文件描述符性质文件描述符的
     int m_listenfd;